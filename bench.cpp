@@ -0,0 +1,395 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <unistd.h>
+
+#include "nn_functions.h"
+#include "ExpandedResWindow.h"
+#include "PAA.h"
+
+// Microbenchmarks of the DTW kernels, window construction, PAA and the file
+// loaders on synthetic random walks. The results are printed as one JSON
+// document, so that the output of two builds can be diffed.
+
+// Random walks from splitmix64, which unlike the distributions of <random>
+// gives the same series on every platform and standard library.
+struct random_walk_generator {
+    std::uint64_t state;
+
+    explicit random_walk_generator(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [-1, 1).
+    double step() {
+        return (next() >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+    }
+
+    // length points, each a step away from the one before, rounded to two
+    // decimals like the return times of the .job files.
+    std::vector<double> walk(std::size_t length) {
+        std::vector<double> values(length);
+        double value = 0;
+        for (std::size_t i = 0; i < length; ++i) {
+            value += step();
+            values[i] = std::round(value * 100) / 100;
+        }
+        return values;
+    }
+};
+
+// Writes count random walks of the given length as a .job file.
+bool write_random_job(const std::string& fname, std::size_t count, std::size_t length,
+                      std::uint64_t seed) {
+    std::ofstream out(fname.c_str());
+    random_walk_generator generator(seed);
+    for (std::size_t s = 0; s < count; ++s) {
+        out << "synthetic synthetic_" << s << "\n";
+        std::vector<double> values = generator.walk(length);
+        for (std::size_t i = 0; i < length; ++i) {
+            out << (i ? " " : "") << values[i];
+        }
+        out << "\n";
+        for (std::size_t i = 0; i < length; ++i) {
+            out << (i ? " " : "") << i;
+        }
+        out << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+// A path in the temporary directory that nothing else uses.
+std::string temporary_path(const char* suffix) {
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/bench_XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        cerr << "Could not create a temporary file in " << (dir ? dir : "/tmp") << "." << endl;
+        exit(1);
+    }
+    close(fd);
+    std::remove(path.c_str());
+    return path + suffix;
+}
+
+// Timings of one benchmark: nanoseconds per run, the median and the fastest
+// of the samples.
+struct bench_timing {
+    long iterations;
+    double median_ns;
+    double min_ns;
+};
+
+// Results are summed into here, so that the runs cannot be optimised away.
+volatile double bench_sink;
+
+// Takes samples samples of run, each repeating it for at least
+// min_time/samples seconds (as calibrated on the first runs).
+bench_timing measure(const std::function<double()>& run, double min_time, int samples) {
+    typedef std::chrono::steady_clock clock;
+    double target = min_time / samples;
+    long iterations = 1;
+    while (true) {
+        clock::time_point start = clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            bench_sink = bench_sink + run();
+        }
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if (seconds >= target || iterations >= (1L << 30)) {
+            break;
+        }
+        iterations = seconds > 0 ? std::max(iterations * 2, long(iterations * target / seconds * 1.2))
+                                 : iterations * 2;
+    }
+
+    std::vector<double> ns(samples);
+    for (int s = 0; s < samples; ++s) {
+        clock::time_point start = clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            bench_sink = bench_sink + run();
+        }
+        ns[s] = std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+    }
+    std::sort(ns.begin(), ns.end());
+    bench_timing timing;
+    timing.iterations = iterations;
+    timing.median_ns = ns[samples / 2];
+    timing.min_ns = ns[0];
+    return timing;
+}
+
+// One benchmark: run is timed, and units is the number of unit ("cell" of
+// the cost matrix, or "point" of the series) it processes, for a per unit
+// figure; 0 if that means nothing.
+struct bench_case {
+    std::string name;
+    long length;
+    long radius;
+    const char* unit;
+    double units;
+    std::function<double()> run;
+    // Lanes of a batch that STRI::groupBatch fills together in vectors, -1
+    // for the cases that are not batches.
+    long vector_lanes = -1;
+};
+
+// Lanes of the batch cases, summing up the distances.
+struct bench_lanes {
+    double sum = 0;
+
+    double cutoff(JInt) {
+        return std::numeric_limits<double>::max();
+    }
+
+    void result(JInt, double distance) {
+        sum += distance;
+    }
+};
+
+// Number of lanes of windows in groups of two or more, see STRI::groupBatch.
+long vector_lanes(SearchWindow const* const* windows, JInt count) {
+    JInt groups[STRI::BATCH_LANES][STRI::BATCH_LANES];
+    JInt sizes[STRI::BATCH_LANES];
+    JInt numOfGroups = STRI::groupBatch(windows, count, groups, sizes);
+    long lanes = 0;
+    for (JInt g = 0; g < numOfGroups; ++g) {
+        lanes += sizes[g] > 1 ? sizes[g] : 0;
+    }
+    return lanes;
+}
+
+int main(int argc, char** argv) {
+    double min_time = 0.2;
+    int samples = 5;
+    bool compact = false;
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--min_time=", 11) == 0) {
+            min_time = std::atof(argv[i] + 11);
+        } else if (std::strncmp(argv[i], "--samples=", 10) == 0) {
+            samples = std::atoi(argv[i] + 10);
+        } else if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (std::strcmp(argv[i], "--compact") == 0) {
+            compact = true;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--min_time=SECONDS] [--samples=N] [--filter=NAME] [--compact]" << endl;
+            cerr << "  --min_time  time spent measuring each benchmark (default 0.2)" << endl;
+            cerr << "  --samples   number of samples the median is taken of (default 5)" << endl;
+            cerr << "  --filter    only run the benchmarks whose name contains NAME" << endl;
+            cerr << "  --compact   print compact JSON" << endl;
+            return 1;
+        }
+    }
+    if (min_time <= 0 || samples < 1) {
+        cerr << "--min_time and --samples must be positive." << endl;
+        return 1;
+    }
+
+    const long lengths[] = {250, 1000, 4000};
+    const long radii[] = {0, 5, 20, 50};
+    const std::size_t job_series = 64;
+
+    // The series and windows the cases run on, kept alive until the end.
+    std::vector<std::unique_ptr<std::vector<double> > > values;
+    std::vector<std::unique_ptr<TimeSeries<double,1> > > series;
+    std::vector<std::shared_ptr<void> > fixtures;
+    std::vector<bench_case> cases;
+    std::vector<std::string> files;
+
+    for (long length : lengths) {
+        // A pair of unequal lengths, as in the real data.
+        random_walk_generator generator(length);
+        values.emplace_back(new std::vector<double>(generator.walk(length)));
+        values.emplace_back(new std::vector<double>(generator.walk(length - length / 10)));
+        series.emplace_back(new TimeSeries<double,1>(values[values.size() - 2]->data(), length));
+        series.emplace_back(new TimeSeries<double,1>(values.back()->data(), length - length / 10));
+        const TimeSeries<double,1>& a = *series[series.size() - 2];
+        const TimeSeries<double,1>& b = *series.back();
+        double cells = double(a.size()) * b.size();
+
+        cases.push_back({"stri_dist_full", length, -1, "cell", cells, [&a, &b]() {
+            return STRI::getWarpDistBetween(a, b, EuclideanDistance());
+        }});
+        cases.push_back({"stri_info_full", length, -1, "cell", cells, [&a, &b]() {
+            return STRI::getWarpInfoBetween(a, b, EuclideanDistance()).getDistance();
+        }});
+        cases.push_back({"paa", length, -1, "point", double(a.size()), [&a]() {
+            return PAA<double,1>(a, a.size() / 2).getMeasurement(0, 0);
+        }});
+        cases.push_back({"paa_pyramid", length, -1, "point", double(a.size()), [&a]() {
+            return double(PAAPyramid<double,1>(a).numOfLevels());
+        }});
+
+        // A batch: the first series against STRI::BATCH_LANES others of the
+        // second one's length.
+        const TimeSeries<double,1>* batchI[STRI::BATCH_LANES];
+        const TimeSeries<double,1>* batchJ[STRI::BATCH_LANES];
+        for (JInt lane = 0; lane < STRI::BATCH_LANES; ++lane) {
+            values.emplace_back(new std::vector<double>(generator.walk(b.size())));
+            series.emplace_back(new TimeSeries<double,1>(values.back()->data(), b.size()));
+            batchI[lane] = &a;
+            batchJ[lane] = series.back().get();
+        }
+
+        std::shared_ptr<PAA<double,1> > shrunkA(new PAA<double,1>(a, a.size() / 2));
+        std::shared_ptr<PAA<double,1> > shrunkB(new PAA<double,1>(b, b.size() / 2));
+        fixtures.push_back(shrunkA);
+        fixtures.push_back(shrunkB);
+        for (long radius : radii) {
+            std::shared_ptr<SakoeChibaWindow> band(new SakoeChibaWindow(a, b, radius));
+            fixtures.push_back(band);
+            cases.push_back({"stri_dist_window", length, radius, "cell", double(band->size()), [&a, &b, band]() {
+                return STRI::getWarpDistBetween(a, b, *band, EuclideanDistance());
+            }});
+            cases.push_back({"stri_info_window", length, radius, "cell", double(band->size()), [&a, &b, band]() {
+                return STRI::getWarpInfoBetween(a, b, *band, EuclideanDistance()).getDistance();
+            }});
+            // cdtw of a batch, whose bands line up, in vectors and pair by pair.
+            std::shared_ptr<std::vector<SakoeChibaWindow> > bands(new std::vector<SakoeChibaWindow>());
+            std::shared_ptr<std::vector<const SearchWindow*> > windows(new std::vector<const SearchWindow*>());
+            double batchCells = 0;
+            for (JInt lane = 0; lane < STRI::BATCH_LANES; ++lane) {
+                bands->emplace_back(a, *batchJ[lane], radius);
+            }
+            for (const SakoeChibaWindow& window : *bands) {
+                windows->push_back(&window);
+                batchCells += window.size();
+            }
+            fixtures.push_back(bands);
+            fixtures.push_back(windows);
+            long lanes = vector_lanes(windows->data(), STRI::BATCH_LANES);
+            cases.push_back({"batch_cdtw", length, radius, "cell", batchCells, [batchI, batchJ, windows]() {
+                bench_lanes lanes;
+                STRI::getWarpDistsBetween(batchI, batchJ, windows->data(), STRI::BATCH_LANES,
+                                          EuclideanDistance(), lanes);
+                return lanes.sum;
+            }, lanes});
+            cases.push_back({"batch_cdtw_pairwise", length, radius, "cell", batchCells, [batchI, batchJ, windows]() {
+                double sum = 0;
+                for (JInt lane = 0; lane < STRI::BATCH_LANES; ++lane) {
+                    sum += STRI::getWarpDistBetween(*batchI[lane], *batchJ[lane], *(*windows)[lane],
+                                                    EuclideanDistance());
+                }
+                return sum;
+            }});
+
+            // FastDTW of the batch; the lanes' windows follow their own warp
+            // paths, so fewer of them line up.
+            std::optional<ExpandedResWindow> projected[STRI::BATCH_LANES];
+            const SearchWindow* projectedWindows[STRI::BATCH_LANES];
+            for (JInt lane = 0; lane < STRI::BATCH_LANES; ++lane) {
+                FAST::projectSearchWindow(a, (const PAAPyramid<double,1>*)NULL, *batchJ[lane],
+                                          (const PAAPyramid<double,1>*)NULL, radius, EuclideanDistance(),
+                                          projected[lane]);
+                projectedWindows[lane] = &*projected[lane];
+            }
+            lanes = vector_lanes(projectedWindows, STRI::BATCH_LANES);
+            cases.push_back({"batch_fast", length, radius, "", 0, [batchI, batchJ, radius]() {
+                const PAAPyramid<double,1>* pyramids[STRI::BATCH_LANES] = {};
+                bench_lanes lanes;
+                FAST::getWarpDistsBetween(batchI, pyramids, batchJ, pyramids, STRI::BATCH_LANES, radius,
+                                          EuclideanDistance(), lanes);
+                return lanes.sum;
+            }, lanes});
+            cases.push_back({"batch_fast_pairwise", length, radius, "", 0, [batchI, batchJ, radius]() {
+                double sum = 0;
+                for (JInt lane = 0; lane < STRI::BATCH_LANES; ++lane) {
+                    sum += FAST::getWarpDistBetween(*batchI[lane], *batchJ[lane], radius, EuclideanDistance());
+                }
+                return sum;
+            }});
+
+            cases.push_back({"fast_dist", length, radius, "", 0, [&a, &b, radius]() {
+                return FAST::getWarpDistBetween(a, b, radius, EuclideanDistance());
+            }});
+            cases.push_back({"fast_info", length, radius, "", 0, [&a, &b, radius]() {
+                return FAST::getWarpInfoBetween(a, b, radius, EuclideanDistance()).getDistance();
+            }});
+
+            std::shared_ptr<TimeWarpInfo<double> > shrunkInfo(new TimeWarpInfo<double>(
+                FAST::getWarpInfoBetween(*shrunkA, *shrunkB, radius, EuclideanDistance())));
+            fixtures.push_back(shrunkInfo);
+            cases.push_back({"expanded_res_window", length, radius, "", 0, [&a, &b, shrunkA, shrunkB, shrunkInfo, radius]() {
+                ExpandedResWindow window(a, b, *shrunkA, *shrunkB, *shrunkInfo->getPath(), radius);
+                return double(window.size());
+            }});
+        }
+
+        std::string job = temporary_path(".job");
+        std::string bin = temporary_path(".bin");
+        files.push_back(job);
+        files.push_back(bin);
+        if (!write_random_job(job, job_series, length, length)) {
+            cerr << "Could not write \"" << job << "\"." << endl;
+            return 1;
+        }
+        if (!write_TSbinary(load_TSfile(job, 0), bin, false)) {
+            cerr << "Could not write \"" << bin << "\"." << endl;
+            return 1;
+        }
+        double points = double(job_series) * length;
+        cases.push_back({"load_job", length, -1, "point", points, [job]() {
+            return double(load_TSfile(job, 0).size());
+        }});
+        cases.push_back({"load_binary", length, -1, "point", points, [bin]() {
+            return double(load_TSfile(bin, 0, false).size());
+        }});
+        cases.push_back({"load_binary_times", length, -1, "point", points, [bin]() {
+            return double(load_TSfile(bin, 0).size());
+        }});
+    }
+
+    json_writer json(compact);
+    json.begin(NULL, '{');
+    json.field("min_time", min_time);
+    json.field("samples", long(samples));
+    json.field("threads", long(omp_get_max_threads()));
+    json.begin("benchmarks", '[');
+    for (const bench_case& c : cases) {
+        if (c.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        bench_timing timing = measure(c.run, min_time, samples);
+        json.begin(NULL, '{');
+        json.field("name", c.name);
+        json.field("length", c.length);
+        if (c.radius >= 0) {
+            json.field("radius", c.radius);
+        }
+        json.field("iterations", timing.iterations);
+        json.field("median_ns", timing.median_ns);
+        json.field("min_ns", timing.min_ns);
+        if (c.units > 0) {
+            json.field("unit", std::string(c.unit));
+            json.field("median_ns_per_unit", timing.median_ns / c.units);
+        }
+        if (c.vector_lanes >= 0) {
+            json.field("vector_lanes", c.vector_lanes);
+        }
+        json.end('}');
+    }
+    json.end(']');
+    json.end('}');
+    json.out += '\n';
+    cout.write(json.out.data(), json.out.size());
+    cout.flush();
+
+    for (const std::string& file : files) {
+        std::remove(file.c_str());
+    }
+    return 0;
+}
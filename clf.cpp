@@ -1,5 +1,6 @@
 #include "cmdline.h"
 #include "nn_functions.h"
+#include "distance_matrix.h"
 
 int main(int argc, char** argv) {
     struct gengetopt_args_info ai;
@@ -8,12 +9,93 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    std::vector<taggedTS> query =
-      load_TSfile(ai.query_filename_arg, ai.verbose_flag);
+    if (ai.k_arg < 0) {
+        cerr << "--k must not be negative." << endl;
+        exit(1);
+    }
+    if (ai.radius_arg < 0) {
+        cerr << "--radius must not be negative." << endl;
+        exit(1);
+    }
+    if (ai.distance_matrix_given) {
+        if (ai.modelling_given || ai.k_given || ai.cache_given || ai.stats_given ||
+            ai.validate_precision_given) {
+            cerr << "--modelling, --k, --cache, --stats and --validate_precision do not apply to "
+                    "--distance_matrix." << endl;
+            exit(1);
+        }
+    } else if (!ai.query_filename_given) {
+        cerr << "--query_filename is required unless --distance_matrix is given." << endl;
+        exit(1);
+    }
+
+    dtw_settings settings;
+    settings.radius = ai.radius_arg;
+    if (std::strcmp(ai.algorithm_arg, "cdtw") == 0) {
+        settings.algorithm = ALGORITHM_CDTW;
+    } else if (std::strcmp(ai.algorithm_arg, "full") == 0) {
+        settings.algorithm = ALGORITHM_FULL;
+    } else {
+        settings.algorithm = ALGORITHM_FASTDTW;
+    }
+
+    bool use_float = std::strcmp(ai.precision_arg, "float") == 0;
+    // The absolute times are read in the time domain, and hashed for the cache.
+    bool load_times = ai.use_time_domain_flag || ai.cache_given;
+
     std::vector<taggedTS> reference =
-      load_TSfile(ai.reference_filename_arg, ai.verbose_flag);
+      load_TSfile(ai.reference_filename_arg, ai.verbose_flag, load_times);
+    if (use_float) {
+        for (taggedTS& ts : reference) {
+            narrow_TS(ts);
+        }
+    }
+
+    if (ai.distance_matrix_given) {
+        if (!write_distance_matrix(reference, ai.use_time_domain_flag, settings, use_float,
+                                   ai.distance_matrix_arg, ai.verbose_flag)) {
+            cerr << "Could not write the distance matrix to \"" << ai.distance_matrix_arg << "\"." << endl;
+            exit(1);
+        }
+        return 0;
+    }
+
+    std::vector<taggedTS> query =
+      load_TSfile(ai.query_filename_arg, ai.verbose_flag, load_times);
+    if (use_float) {
+        for (taggedTS& ts : query) {
+            narrow_TS(ts);
+        }
+    }
 
-    one_NN_many(query, reference, ai.use_time_domain_flag, ai.modelling_flag);
+    std::unique_ptr<distance_cache> cache;
+    if (ai.cache_given) {
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < query.size(); ++i) {
+            hash_TS(query[i]);
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < reference.size(); ++i) {
+            hash_TS(reference[i]);
+        }
+        cache.reset(new distance_cache(ai.cache_arg, settings.algorithm, settings.radius,
+                                       ai.use_time_domain_flag, use_float, omp_get_max_threads()));
+    }
+
+    nn_options options;
+    options.k = ai.k_arg;
+    options.use_float = use_float;
+    options.validate_precision = ai.validate_precision_flag;
+    options.compact = ai.compact_flag;
+    options.verbose = ai.verbose_flag;
+    options.stats_filename = ai.stats_given ? ai.stats_arg : NULL;
+    one_NN_many(query, reference, ai.use_time_domain_flag, settings, ai.modelling_flag,
+                options, cache.get());
+
+    if (cache && !cache->save()) {
+        cerr << "Could not write the distance cache to \"" << ai.cache_arg << "\"." << endl;
+        exit(1);
+    }
 
     return 0;
 }
@@ -0,0 +1,243 @@
+#ifndef DISTANCE_CACHE_H
+#define DISTANCE_CACHE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+#include "tagged_ts.h"
+#include "ts_binary.h"
+#include "mapped_file.h"
+
+// Distances computed by earlier runs, kept in a file between runs (see
+// --cache) and keyed by the content hashes of both series (see hash_TS)
+// and the settings they were compared under. The file is an open addressing
+// hash table, meant to be memory mapped. Layout, integers in native byte
+// order as in the binary dataset format (see ts_binary.h):
+//
+//   distance_cache_header
+//   distance_cache_entry[capacity]   capacity a power of two, at most half
+//                                    of the entries in use, empty ones zero
+//
+// An entry is found by linear probing from distance_cache::slot(). Entries
+// are never evicted; delete the file to start over.
+
+const char DISTANCE_CACHE_MAGIC[8] = {'K','N','N','D','T','W','C','\0'};
+const std::uint32_t DISTANCE_CACHE_VERSION = 1;
+
+enum distance_cache_kind {
+    CACHE_EMPTY = 0,
+    // distance is the distance of the pair
+    CACHE_EXACT = 1,
+    // the comparison was abandoned; the pair is further apart than distance
+    CACHE_BOUND = 2
+};
+
+struct distance_cache_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t count;
+    std::uint64_t capacity;
+    std::uint64_t entries_offset;
+};
+
+struct distance_cache_entry {
+    std::uint64_t query_hash;
+    std::uint64_t candidate_hash;
+    // algorithm, radius, time domain and precision; see distance_cache()
+    std::uint32_t settings;
+    std::uint32_t kind;
+    double distance;
+};
+
+class distance_cache {
+public:
+    // Opens the cache in fname for comparisons under algorithm (a
+    // dtw_algorithm) with radius, in the time domain if use_time_domain and
+    // in single precision if use_float, by up to threads threads. A missing
+    // file is an empty cache; an unusable one is reported and replaced by
+    // save().
+    distance_cache(const std::string& fname, int algorithm, int radius,
+                   bool use_time_domain, bool use_float, int threads)
+        : fname(fname), entries(NULL), capacity(0), count(0), added(threads > 0 ? threads : 1) {
+        settings = static_cast<std::uint32_t>(algorithm) |
+            (use_time_domain ? 1u << 2 : 0) | (use_float ? 1u << 3 : 0) |
+            (static_cast<std::uint32_t>(radius) << 4);
+
+        if (access(fname.c_str(), F_OK) != 0) {
+            return;
+        }
+        file = mapped_file::open(fname);
+        distance_cache_header header;
+        const char* problem = NULL;
+        if (!file || file->size < sizeof(header)) {
+            problem = "truncated header";
+        } else {
+            std::memcpy(&header, file->data, sizeof(header));
+            if (std::memcmp(header.magic, DISTANCE_CACHE_MAGIC, sizeof(header.magic)) != 0) {
+                problem = "bad magic";
+            } else if (header.version != DISTANCE_CACHE_VERSION) {
+                problem = "unsupported version";
+            } else if (header.byte_order != TS_BINARY_BYTE_ORDER) {
+                problem = "written on a machine of different byte order";
+            } else if (header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+                       header.entries_offset % sizeof(double) != 0 ||
+                       header.entries_offset > file->size ||
+                       (file->size - header.entries_offset) / sizeof(distance_cache_entry) < header.capacity) {
+                problem = "truncated table";
+            }
+        }
+        if (problem) {
+            cerr << "Ignoring distance cache \"" << fname << "\": " << problem << endl;
+            file.reset();
+            return;
+        }
+        entries = reinterpret_cast<const distance_cache_entry*>(file->data + header.entries_offset);
+        capacity = header.capacity;
+        count = header.count;
+    }
+
+    // Looks the pair up in the file; returns false if it is not in there.
+    // The mapping is never written to, so any number of threads can look up
+    // at the same time.
+    bool find(std::uint64_t query_hash, std::uint64_t candidate_hash,
+              distance_cache_entry& entry) const {
+        std::uint64_t first = slot(query_hash, candidate_hash, settings);
+        for (std::uint64_t probe = 0; probe < capacity; ++probe) {
+            const distance_cache_entry& e = entries[(first + probe) & (capacity - 1)];
+            if (e.kind == CACHE_EMPTY) {
+                return false;
+            }
+            if (e.query_hash == query_hash && e.candidate_hash == candidate_hash &&
+                e.settings == settings) {
+                entry = e;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Keeps a result of this run for save(): the distance of the pair, or
+    // (kind CACHE_BOUND) the cutoff its comparison was abandoned at. Every
+    // thread appends to a list of its own.
+    void add(int thread, std::uint64_t query_hash, std::uint64_t candidate_hash,
+             distance_cache_kind kind, double distance) {
+        distance_cache_entry entry = {query_hash, candidate_hash, settings,
+                                      static_cast<std::uint32_t>(kind), distance};
+        added[thread].entries.push_back(entry);
+    }
+
+    // Number of entries in the file, and added by this run.
+    std::size_t size() const {
+        std::size_t size = count;
+        for (std::size_t t = 0; t < added.size(); ++t) {
+            size += added[t].entries.size();
+        }
+        return size;
+    }
+
+    // Writes the entries of the file and the ones added to a new table. It
+    // is written next to fname and renamed over it, so that other runs
+    // reading the cache at the same time see either table in full (though
+    // of two runs saving at once, only the last one's results are kept).
+    // Returns false if the table could not be written.
+    bool save() {
+        if (size() == count) {
+            return true;
+        }
+        std::uint64_t new_capacity = 16;
+        while (new_capacity < 2 * size()) {
+            new_capacity *= 2;
+        }
+        std::vector<distance_cache_entry> table(new_capacity);
+        std::memset(table.data(), 0, table.size() * sizeof(distance_cache_entry));
+        std::uint64_t new_count = 0;
+        for (std::uint64_t s = 0; s < capacity; ++s) {
+            if (entries[s].kind != CACHE_EMPTY) {
+                new_count += insert(table, entries[s]);
+            }
+        }
+        for (std::size_t t = 0; t < added.size(); ++t) {
+            for (const distance_cache_entry& entry : added[t].entries) {
+                new_count += insert(table, entry);
+            }
+        }
+
+        distance_cache_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, DISTANCE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = DISTANCE_CACHE_VERSION;
+        header.byte_order = TS_BINARY_BYTE_ORDER;
+        header.count = new_count;
+        header.capacity = new_capacity;
+        header.entries_offset = align_up(sizeof(header));
+
+        std::string temporary = fname + ".tmp" + std::to_string(getpid());
+        {
+            std::ofstream out(temporary.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+            const std::vector<char> padding(header.entries_offset - sizeof(header), 0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(padding.data(), padding.size());
+            out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(distance_cache_entry));
+            if (!out.flush()) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+        if (std::rename(temporary.c_str(), fname.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // The results one thread added, on a cache line of its own.
+    struct alignas(64) added_entries {
+        std::vector<distance_cache_entry> entries;
+    };
+
+    std::string fname;
+    std::uint32_t settings;
+    std::shared_ptr<const mapped_file> file;
+    const distance_cache_entry* entries;
+    std::uint64_t capacity;
+    std::uint64_t count;
+    std::vector<added_entries> added;
+
+    static std::uint64_t slot(std::uint64_t query_hash, std::uint64_t candidate_hash,
+                              std::uint32_t settings) {
+        return combine_hash(combine_hash(query_hash, candidate_hash), settings);
+    }
+
+    // Puts entry into table, unless table knows more about the pair already:
+    // a distance beats a bound, and a higher bound a lower one. Returns
+    // whether the entry took a new slot.
+    static bool insert(std::vector<distance_cache_entry>& table, const distance_cache_entry& entry) {
+        std::uint64_t mask = table.size() - 1;
+        for (std::uint64_t s = slot(entry.query_hash, entry.candidate_hash, entry.settings);; ++s) {
+            distance_cache_entry& e = table[s & mask];
+            if (e.kind == CACHE_EMPTY) {
+                e = entry;
+                return true;
+            }
+            if (e.query_hash == entry.query_hash && e.candidate_hash == entry.candidate_hash &&
+                e.settings == entry.settings) {
+                if (entry.kind == CACHE_EXACT ||
+                    (e.kind == CACHE_BOUND && entry.distance > e.distance)) {
+                    e = entry;
+                }
+                return false;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef DISTANCE_MATRIX_H
+#define DISTANCE_MATRIX_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <omp.h>
+
+#include "nn_functions.h"
+#include "mapped_file.h"
+
+// Dense matrix of the distances between all pairs of a dataset, meant to be
+// memory mapped (numpy.memmap(fname, dtype=numpy.float64, offset=64,
+// shape=(count, count)) for instance). Layout, integers in native byte order
+// as in the binary dataset format (see ts_binary.h):
+//
+//   distance_matrix_header     padded to matrix_offset (64) bytes
+//   float64[count][count]      row after row; symmetric, zero diagonal
+//
+// Row and column i belong to the i-th series of the dataset, whose tag and
+// UID are on line i of fname + ".index" (i, tag and UID separated by tabs).
+
+const char DISTANCE_MATRIX_MAGIC[8] = {'K','N','N','D','T','W','M','\0'};
+const std::uint32_t DISTANCE_MATRIX_VERSION = 2;
+
+struct distance_matrix_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t value_type;
+    // the dtw_algorithm, its radius and whether the time domain was used
+    std::uint32_t algorithm;
+    std::int32_t radius;
+    std::uint32_t use_time_domain;
+    // the ts_binary_value_type the series and cost matrices were held in
+    // (--precision), whatever value_type the distances are stored as
+    std::uint32_t precision;
+    std::uint64_t count;
+    std::uint64_t matrix_offset;
+};
+
+// Most rows and columns per tile. A tile's series stay in cache while all
+// of its pairs are compared.
+#define DISTANCE_MATRIX_TILE 64
+
+// Least number of tiles per thread, so that the threads still share out the
+// work evenly when some tiles take much longer than others.
+#define DISTANCE_MATRIX_TILES_PER_THREAD 4
+
+// Rows and columns per tile of a matrix of count series computed by threads
+// threads: DISTANCE_MATRIX_TILE, unless that leaves fewer than
+// DISTANCE_MATRIX_TILES_PER_THREAD tiles on and above the diagonal per
+// thread. Tiles stay at least STRI::BATCH_LANES wide to fill the batches.
+std::size_t distance_matrix_tile_size(std::size_t count, int threads) {
+    std::size_t tasks = std::size_t(std::max(threads, 1)) * DISTANCE_MATRIX_TILES_PER_THREAD;
+    // n tiles per side make n * (n + 1) / 2 tiles on and above the diagonal
+    std::size_t n = 1;
+    while (n * (n + 1) / 2 < tasks) {
+        ++n;
+    }
+    return std::max<std::size_t>(STRI::BATCH_LANES, std::min<std::size_t>(DISTANCE_MATRIX_TILE, count / n));
+}
+
+// Lanes of DTWdist_batch that store the distances of one row against
+// consecutive columns in both triangles of the matrix; nothing is pruned.
+struct matrix_lanes {
+    double* matrix;
+    std::size_t count;
+    std::size_t row;
+    const std::size_t* columns;
+
+    double cutoff(JInt) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    void result(JInt c, double distance) {
+        matrix[row * count + columns[c]] = distance;
+        matrix[columns[c] * count + row] = distance;
+    }
+};
+
+// Compares the rows of the tile_size wide tile (first_row, first_column)
+// against its columns, positions in order, i.e. dataset[order[r]] against
+// dataset[order[c]].
+// Only the pairs above the diagonal are compared, each row against up to
+// STRI::BATCH_LANES columns at once under FastDTW and cdtw.
+template <typename ValueType>
+void distance_matrix_tile(const std::vector<taggedTS>& dataset,
+                          const std::vector<std::size_t>& order,
+                          std::size_t first_row,
+                          std::size_t first_column,
+                          std::size_t tile_size,
+                          int use_time_domain,
+                          const dtw_settings& settings,
+                          double* matrix) {
+    std::size_t count = dataset.size();
+    std::size_t last_row = std::min(first_row + tile_size, count);
+    std::size_t last_column = std::min(first_column + tile_size, count);
+    std::size_t batch = settings.algorithm == ALGORITHM_FULL ? 1 : STRI::BATCH_LANES;
+    for (std::size_t r = first_row; r < last_row; ++r) {
+        const taggedTS& query = dataset[order[r]];
+        for (std::size_t first = std::max(first_column, r + 1); first < last_column; first += batch) {
+            std::size_t members = std::min(batch, last_column - first);
+            const taggedTS* candidates[STRI::BATCH_LANES];
+            for (std::size_t c = 0; c < members; ++c) {
+                candidates[c] = &dataset[order[first + c]];
+            }
+            matrix_lanes lanes = {matrix, count, order[r], &order[first]};
+            DTWdist_batch<ValueType>(query, candidates, members, use_time_domain, settings, lanes);
+        }
+    }
+}
+
+// Writes the distances between all pairs of dataset under settings to
+// fname, and its index to fname + ".index"; see distance_matrix_header.
+// DTW is treated as symmetric, so every pair is compared once, with the
+// shorter series as the query; cdtw and FastDTW are not exactly symmetric,
+// and the matrix holds their distances in that direction. The series
+// are tiled in order of length, so that the candidates of a batch are of
+// similar lengths, and the tiles on and above the diagonal are shared out
+// across the threads, most expensive first; see distance_matrix_tile_size.
+// Returns false if a file could not be written.
+bool write_distance_matrix(const std::vector<taggedTS>& dataset,
+                           int use_time_domain,
+                           const dtw_settings& settings,
+                           bool use_float,
+                           const std::string& fname,
+                           int verbose) {
+    double start = omp_get_wtime();
+    std::size_t count = dataset.size();
+    std::uint64_t matrix_offset = align_up(sizeof(distance_matrix_header));
+    std::size_t matrix_size = count * count * sizeof(double);
+    std::shared_ptr<mapped_output_file> file =
+      mapped_output_file::create(fname, matrix_offset + matrix_size);
+    if (!file) {
+        return false;
+    }
+    double* matrix = reinterpret_cast<double*>(file->data + matrix_offset);
+
+    std::vector<std::size_t> order(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&dataset](std::size_t a, std::size_t b)
+    {
+        return dataset[a].series.size() < dataset[b].series.size();
+    });
+
+    // A tile is (cost, first row, first column).
+    typedef std::tuple<double, std::size_t, std::size_t> matrix_tile;
+    std::vector<matrix_tile> tiles;
+    std::size_t tile_size = distance_matrix_tile_size(count, omp_get_max_threads());
+    for (std::size_t first_row = 0; first_row < count; first_row += tile_size) {
+        for (std::size_t first_column = first_row; first_column < count; first_column += tile_size) {
+            double cost = 0;
+            for (std::size_t r = first_row; r < std::min(first_row + tile_size, count); ++r) {
+                for (std::size_t c = std::max(first_column, r + 1);
+                     c < std::min(first_column + tile_size, count); ++c) {
+                    cost += estimated_cost(dataset[order[r]], dataset[order[c]], use_time_domain, settings);
+                }
+            }
+            if (cost > 0) {
+                tiles.emplace_back(cost, first_row, first_column);
+            }
+        }
+    }
+    std::sort(tiles.begin(), tiles.end(), [](const matrix_tile& a, const matrix_tile& b)
+    {
+        return std::get<0>(a) > std::get<0>(b) || (std::get<0>(a) == std::get<0>(b) && a < b);
+    });
+
+    work_stealing_queues queues(tiles.size(), omp_get_max_threads());
+    #pragma omp parallel
+    {
+        std::size_t t;
+        while (queues.next(omp_get_thread_num(), t)) {
+            if (use_float) {
+                distance_matrix_tile<float>(dataset, order, std::get<1>(tiles[t]), std::get<2>(tiles[t]),
+                                            tile_size, use_time_domain, settings, matrix);
+            } else {
+                distance_matrix_tile<double>(dataset, order, std::get<1>(tiles[t]), std::get<2>(tiles[t]),
+                                             tile_size, use_time_domain, settings, matrix);
+            }
+        }
+    }
+
+    // The header goes in last, once the matrix is on disk, so that an
+    // interrupted or failed run does not leave a file that looks complete.
+    if (!file->sync(matrix_offset, matrix_size)) {
+        return false;
+    }
+    distance_matrix_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, DISTANCE_MATRIX_MAGIC, sizeof(header.magic));
+    header.version = DISTANCE_MATRIX_VERSION;
+    header.byte_order = TS_BINARY_BYTE_ORDER;
+    header.value_type = TS_BINARY_FLOAT64;
+    header.algorithm = settings.algorithm;
+    header.radius = settings.radius;
+    header.use_time_domain = use_time_domain ? 1 : 0;
+    header.precision = use_float ? TS_BINARY_FLOAT32 : TS_BINARY_FLOAT64;
+    header.count = count;
+    header.matrix_offset = matrix_offset;
+    std::memcpy(file->data, &header, sizeof(header));
+    if (!file->sync(0, sizeof(header))) {
+        return false;
+    }
+
+    std::ofstream index((fname + ".index").c_str());
+    for (std::size_t i = 0; i < count; ++i) {
+        index << i << '\t' << dataset[i].ts_tag << '\t' << dataset[i].UID << '\n';
+    }
+    if (!index) {
+        return false;
+    }
+
+    if (verbose) {
+        double seconds = omp_get_wtime() - start;
+        std::size_t pairs = count > 0 ? count * (count - 1) / 2 : 0;
+        cerr << "distance matrix of " << count << " series: " << pairs << " pairs in " <<
+            seconds << " s (" << (seconds > 0 ? pairs / seconds : 0) << " pairs/s)\n";
+    }
+    return true;
+}
+
+#endif
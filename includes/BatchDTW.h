@@ -0,0 +1,445 @@
+//
+//  BatchDTW.h
+//  FastDTW-x
+//
+
+#ifndef __FastDTW_x__BatchDTW__
+#define __FastDTW_x__BatchDTW__
+
+#include "Foundation.h"
+#include "FDMath.h"
+#include "FDAssert.h"
+#include "TimeSeries.h"
+#include "SearchWindow.h"
+#include "Workspace.h"
+#include "DTWStatistics.h"
+#include "EuclideanDistance.h"
+#include "DTW.h"
+#include <vector>
+#include <limits>
+#include <cmath>
+
+FD_NS_START
+
+// Windowed DTW of one series against several others in lockstep, one other series per vector lane. The batch is
+//    filled column by column of the shared series, and every row of a column holds the cells of all lanes next to
+//    each other, so each step of the recurrence is one vector operation across the lanes and every load is
+//    contiguous. Each lane has its own length and search window; cells outside a lane's window cost
+//    numeric_limits<double>::max(), as in fillWindowColumn(), so the lanes' distances are bit for bit the ones of the
+//    one pair at a time kernels. A column is filled over the rows of all the lanes' window columns, which only pays
+//    off while the lanes' windows overlap, so the lanes of a batch are first grouped by how well their windows line
+//    up: the Sakoe-Chiba bands of candidates of similar lengths, say, rather than FastDTW windows that follow each
+//    candidate's own warp path.
+namespace STRI {
+    using namespace std;
+
+    // Whether the batch kernels can evaluate DistanceFunction on TimeSeries<ValueType,nDimension>: the double series
+    //    among the ones the anti-diagonal kernels take.
+    template <typename ValueType, JInt nDimension, typename DistanceFunction>
+    struct HasBatchKernel
+    {
+        static const JBool value = false;
+    };
+
+    template <>
+    struct HasBatchKernel<double, 1, EuclideanDistance>
+    {
+        static const JBool value = true;
+    };
+
+    // Number of series one batch compares against: a single AVX-512 register, two AVX2 registers.
+    const JInt BATCH_LANES = 8;
+
+    // Least share of a group's steps (rows of a column times the lanes of the group) that have to be cells of the
+    //    lanes' windows for the lanes to be filled together. Both kernels spend most of a cell on its square root,
+    //    so a step of a group costs nearly as much as a cell of the one pair at a time kernels.
+    const JDouble BATCH_DENSITY = 0.9;
+
+    // Least number of rows a lane's window has to average per column to be filled in a group. A column of a
+    //    narrower window is over before the batch kernel gets going, and the anti-diagonal kernels do better.
+    const JInt BATCH_MIN_ROWS = 8;
+
+    // Least number of lanes of a group. The kernels fill whole vectors, four or eight lanes at a time, whether or
+    //    not the group has a series for every one of them.
+    const JInt BATCH_MIN_GROUP = BATCH_LANES/2;
+
+    // Fills rows from...to of one column of a batch. a is the column's point of the shared series, rows the other
+    //    series' points (BATCH_LANES per row), last and curr the previous and the current column (BATCH_LANES per
+    //    row, row -1 of last readable). Only the first width lanes are used; a lane's cells are only computed in rows
+    //    lo[lane]...hi[lane]. Lowers minCosts to the cheapest cell of every lane.
+    typedef void (*BatchColumn)(double a, const double* rows, const double* last, double* curr, JInt from, JInt to,
+                                const double* lo, const double* hi, double* minCosts, JInt width);
+
+    inline void batchColumnScalar(double a, const double* rows, const double* last, double* curr, JInt from, JInt to,
+                                  const double* lo, const double* hi, double* minCosts, JInt width)
+    {
+        const double outside = numeric_limits<double>::max();
+        for (JInt lane = 0; lane<width; ++lane) {
+            double below = outside;
+            for (JInt j = from; j<=to; ++j) {
+                double diff = a - rows[j*BATCH_LANES + lane];
+                double cost = fd_min(fd_min(last[j*BATCH_LANES + lane], last[(j-1)*BATCH_LANES + lane]), below)
+                              + sqrt(diff*diff);
+                below = (double)j >= lo[lane] && (double)j <= hi[lane] ? cost : outside;
+                curr[j*BATCH_LANES + lane] = below;
+                minCosts[lane] = fd_min(minCosts[lane], below);
+            }
+        }
+    }
+
+#ifdef FD_DIAGONAL_X86
+    __attribute__((target("avx2")))
+    inline void batchColumnAVX2(double a, const double* rows, const double* last, double* curr, JInt from, JInt to,
+                                const double* lo, const double* hi, double* minCosts, JInt width)
+    {
+        const __m256d outside = _mm256_set1_pd(numeric_limits<double>::max());
+        const __m256d point = _mm256_set1_pd(a);
+        for (JInt half = 0; half<width; half+=4) {
+            const __m256d lower = _mm256_loadu_pd(lo+half);
+            const __m256d upper = _mm256_loadu_pd(hi+half);
+            __m256d below = outside;
+            __m256d minCost = _mm256_loadu_pd(minCosts+half);
+            for (JInt j = from; j<=to; ++j) {
+                __m256d diff = _mm256_sub_pd(point, _mm256_loadu_pd(rows + j*BATCH_LANES + half));
+                __m256d minGlobalCost = _mm256_min_pd(_mm256_min_pd(_mm256_loadu_pd(last + j*BATCH_LANES + half),
+                                                                    _mm256_loadu_pd(last + (j-1)*BATCH_LANES + half)),
+                                                      below);
+                __m256d cost = _mm256_add_pd(minGlobalCost, _mm256_sqrt_pd(_mm256_mul_pd(diff, diff)));
+                __m256d row = _mm256_set1_pd((double)j);
+                __m256d inside = _mm256_and_pd(_mm256_cmp_pd(row, lower, _CMP_GE_OQ),
+                                               _mm256_cmp_pd(row, upper, _CMP_LE_OQ));
+                below = _mm256_blendv_pd(outside, cost, inside);
+                _mm256_storeu_pd(curr + j*BATCH_LANES + half, below);
+                minCost = _mm256_min_pd(minCost, below);
+            }
+            _mm256_storeu_pd(minCosts+half, minCost);
+        }
+    }
+
+    // GCC's AVX-512 intrinsics start from deliberately undefined registers, which -Wall reports.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f")))
+    inline void batchColumnAVX512(double a, const double* rows, const double* last, double* curr, JInt from, JInt to,
+                                  const double* lo, const double* hi, double* minCosts, JInt)
+    {
+        const __m512d outside = _mm512_set1_pd(numeric_limits<double>::max());
+        const __m512d point = _mm512_set1_pd(a);
+        const __m512d lower = _mm512_loadu_pd(lo);
+        const __m512d upper = _mm512_loadu_pd(hi);
+        __m512d below = outside;
+        __m512d minCost = _mm512_loadu_pd(minCosts);
+        for (JInt j = from; j<=to; ++j) {
+            __m512d diff = _mm512_sub_pd(point, _mm512_loadu_pd(rows + j*BATCH_LANES));
+            __m512d minGlobalCost = _mm512_min_pd(_mm512_min_pd(_mm512_loadu_pd(last + j*BATCH_LANES),
+                                                                _mm512_loadu_pd(last + (j-1)*BATCH_LANES)),
+                                                  below);
+            __m512d cost = _mm512_add_pd(minGlobalCost, _mm512_sqrt_pd(_mm512_mul_pd(diff, diff)));
+            __m512d row = _mm512_set1_pd((double)j);
+            __mmask8 inside = _mm512_cmp_pd_mask(row, lower, _CMP_GE_OQ) & _mm512_cmp_pd_mask(row, upper, _CMP_LE_OQ);
+            below = _mm512_mask_blend_pd(inside, outside, cost);
+            _mm512_storeu_pd(curr + j*BATCH_LANES, below);
+            minCost = _mm512_min_pd(minCost, below);
+        }
+        _mm512_storeu_pd(minCosts, minCost);
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    inline BatchColumn selectBatchColumn()
+    {
+#ifdef FD_DIAGONAL_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return batchColumnAVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return batchColumnAVX2;
+#endif
+        return batchColumnScalar;
+    }
+
+    inline BatchColumn batchColumn()
+    {
+        static const BatchColumn column = selectBatchColumn();
+        return column;
+    }
+
+    // Rows lo...hi of one column of a window; hi < lo for a column the window does not reach.
+    struct BatchBounds
+    {
+        JInt lo;
+        JInt hi;
+    };
+
+    // Rows of the columns of a group of lanes, whose windows' rows span the bounds of joint, plus a lane whose
+    //    window's rows are bounds: the sum over the numOfColumns columns of the span from the lowest to the highest
+    //    row of either. Stops counting once past limit.
+    inline JLong batchSteps(const BatchBounds* joint, const BatchBounds* bounds, JInt numOfColumns, JDouble limit)
+    {
+        JLong numOfSteps = 0;
+        for (JInt i = 0; i<numOfColumns && numOfSteps<=limit; ++i) {
+            JInt from = joint[i].lo;
+            JInt to = joint[i].hi;
+            if (bounds[i].lo <= bounds[i].hi) {
+                from = to < from ? bounds[i].lo : fd_min(from, bounds[i].lo);
+                to = fd_max(to, bounds[i].hi);
+            }
+            numOfSteps += fd_max(to - from + 1, (JInt)0);
+        }
+        return numOfSteps;
+    }
+
+    // Splits the count lanes of a batch into groups to be filled together: greedily, in order of the lanes, so that
+    //    at least BATCH_DENSITY of the steps of every group are cells of its lanes' windows. Lanes whose windows are
+    //    narrower than BATCH_MIN_ROWS, and the lanes of groups smaller than BATCH_MIN_GROUP, make groups of their
+    //    own. Group g is groups[g][0...sizes[g]-1]. Returns the number of groups.
+    inline JInt groupBatch(SearchWindow const* const* windows, JInt count, JInt groups[][BATCH_LANES], JInt* sizes)
+    {
+        JInt numOfGroups = 0;
+        JInt numOfColumns = 0;
+        JBool grouped[BATCH_LANES] = {};
+        for (JInt lane = 0; lane<count; ++lane) {
+            if (windows[lane]->size() < (JLong)BATCH_MIN_ROWS*(windows[lane]->maxI() + 1)) {
+                groups[numOfGroups][0] = lane;
+                sizes[numOfGroups++] = 1;
+                grouped[lane] = true;
+            }
+            else {
+                numOfColumns = fd_max(numOfColumns, windows[lane]->maxI() + 1);
+            }
+        }
+        // Fewer than BATCH_MIN_GROUP wide windows leave nothing to group.
+        if (numOfGroups > count-BATCH_MIN_GROUP) {
+            for (JInt lane = 0; lane<count; ++lane) {
+                if (!grouped[lane]) {
+                    groups[numOfGroups][0] = lane;
+                    sizes[numOfGroups++] = 1;
+                }
+            }
+            return numOfGroups;
+        }
+        // The row bounds of every lane's window, and the ones of the group being put together.
+        WorkspaceBuffer<BatchBounds> boundsBuffer(count*numOfColumns);
+        WorkspaceBuffer<BatchBounds> jointBuffer(numOfColumns);
+        BatchBounds* joint = jointBuffer->data();
+        for (JInt lane = 0; lane<count; ++lane) {
+            if (grouped[lane]) {
+                continue;
+            }
+            const SearchWindow& window = *windows[lane];
+            BatchBounds* bounds = boundsBuffer->data() + lane*numOfColumns;
+            for (JInt i = 0; i<numOfColumns; ++i) {
+                bounds[i].lo = i <= window.maxI() ? window.minJForI(i) : 0;
+                bounds[i].hi = i <= window.maxI() ? window.maxJForI(i) : -1;
+            }
+        }
+        for (JInt seed = 0; seed<count; ++seed) {
+            if (grouped[seed]) {
+                continue;
+            }
+            JInt* group = groups[numOfGroups];
+            JInt size = 0;
+            group[size++] = seed;
+            grouped[seed] = true;
+            JLong numOfCells = windows[seed]->size();
+            copy(boundsBuffer->data() + seed*numOfColumns, boundsBuffer->data() + (seed+1)*numOfColumns, joint);
+            for (JInt lane = seed+1; lane<count; ++lane) {
+                if (grouped[lane]) {
+                    continue;
+                }
+                const BatchBounds* bounds = boundsBuffer->data() + lane*numOfColumns;
+                JDouble limit = (numOfCells + windows[lane]->size())/(BATCH_DENSITY*(size+1));
+                if (batchSteps(joint, bounds, numOfColumns, limit) > limit) {
+                    continue;
+                }
+                group[size++] = lane;
+                grouped[lane] = true;
+                numOfCells += windows[lane]->size();
+                for (JInt i = 0; i<numOfColumns; ++i) {
+                    if (bounds[i].lo <= bounds[i].hi) {
+                        joint[i].lo = joint[i].hi < joint[i].lo ? bounds[i].lo : fd_min(joint[i].lo, bounds[i].lo);
+                        joint[i].hi = fd_max(joint[i].hi, bounds[i].hi);
+                    }
+                }
+            }
+            if (size >= BATCH_MIN_GROUP) {
+                sizes[numOfGroups++] = size;
+                continue;
+            }
+            // Too few lanes to make up for the vector lanes the group leaves empty.
+            for (JInt k = 0; k<size; ++k) {
+                groups[numOfGroups][0] = group[k];
+                sizes[numOfGroups++] = 1;
+            }
+        }
+        return numOfGroups;
+    }
+
+    // Windowed DTW distances of the count lanes of group (indexes into tsI, tsJ and windows) filled together, one
+    //    lane per vector lane, see getWarpDistsBetween().
+    template <typename Lanes>
+    void fillBatch(TimeSeries<double,1> const* const* tsI, TimeSeries<double,1> const* const* tsJ,
+                   SearchWindow const* const* windows, const JInt* group, JInt count, Lanes& lanes)
+    {
+        const double outside = numeric_limits<double>::max();
+        JInt numOfRows = 0;
+        JInt numOfColumns = 0;
+        for (JInt lane = 0; lane<count; ++lane) {
+            numOfRows = fd_max(numOfRows, tsJ[group[lane]]->size());
+            numOfColumns = fd_max(numOfColumns, windows[group[lane]]->maxI() + 1);
+        }
+        const double* points = tsI[group[0]]->data();
+        // AVX2 fills four lanes at a time; a group of up to four leaves the other half alone.
+        const JInt width = count <= BATCH_LANES/2 ? BATCH_LANES/2 : BATCH_LANES;
+
+        // The lanes' series side by side, row after row.
+        WorkspaceBuffer<double> rowsBuffer(numOfRows*BATCH_LANES, 0.0);
+        double* rows = rowsBuffer->data();
+        for (JInt lane = 0; lane<count; ++lane) {
+            const double* values = tsJ[group[lane]]->data();
+            for (JInt j = 0; j<tsJ[group[lane]]->size(); ++j) {
+                rows[j*BATCH_LANES + lane] = values[j];
+            }
+        }
+        // Two columns of all lanes, each with row -1 in front. Rows a column did not fill cost outside, and row -1
+        //    of the column before the first one costs 0, which turns the recurrence at (0,0) into its local cost.
+        WorkspaceBuffer<double> lastBuffer((numOfRows+1)*BATCH_LANES, outside);
+        WorkspaceBuffer<double> currBuffer((numOfRows+1)*BATCH_LANES, outside);
+        DTWStatistics::local().addCostMatrix(2*(numOfRows+1)*BATCH_LANES*(JLong)sizeof(double));
+        double* last = lastBuffer->data() + BATCH_LANES;
+        double* curr = currBuffer->data() + BATCH_LANES;
+        for (JInt lane = 0; lane<BATCH_LANES; ++lane) {
+            last[lane - BATCH_LANES] = 0.0;
+        }
+
+        const BatchColumn fill = batchColumn();
+        JBool active[BATCH_LANES];
+        double cutoffs[BATCH_LANES];
+        JInt numOfActive = count;
+        for (JInt lane = 0; lane<BATCH_LANES; ++lane) {
+            active[lane] = lane < count;
+            if (active[lane]) {
+                cutoffs[lane] = lanes.cutoff(group[lane]);
+            }
+        }
+        JLong numOfFilledCells = 0;
+        // Rows filled in the columns last and curr hold.
+        JInt lastFrom = 0, lastTo = -1;
+        JInt currFrom = 0, currTo = -1;
+        for (JInt i = 0; i<numOfColumns && numOfActive>0; ++i) {
+            double lo[BATCH_LANES];
+            double hi[BATCH_LANES];
+            double minCosts[BATCH_LANES];
+            JInt from = numeric_limits<JInt>::max();
+            JInt to = -1;
+            for (JInt lane = 0; lane<BATCH_LANES; ++lane) {
+                minCosts[lane] = outside;
+                if (active[lane]) {
+                    const SearchWindow& window = *windows[group[lane]];
+                    lo[lane] = window.minJForI(i);
+                    hi[lane] = window.maxJForI(i);
+                    from = fd_min(from, window.minJForI(i));
+                    to = fd_max(to, window.maxJForI(i));
+                }
+                else {
+                    lo[lane] = outside;
+                    hi[lane] = -outside;
+                }
+            }
+            // What is left of the column curr held before must not be read as part of this one.
+            for (JInt j = currFrom; j<=currTo; ++j) {
+                if (j < from || j > to) {
+                    for (JInt lane = 0; lane<BATCH_LANES; ++lane) {
+                        curr[j*BATCH_LANES + lane] = outside;
+                    }
+                }
+            }
+            fill(points[i], rows, last, curr, from, to, lo, hi, minCosts, width);
+            if (i == 0) {
+                for (JInt lane = 0; lane<BATCH_LANES; ++lane) {
+                    last[lane - BATCH_LANES] = outside;
+                }
+            }
+
+            for (JInt lane = 0; lane<count; ++lane) {
+                if (!active[lane]) {
+                    continue;
+                }
+                // Counted like the one pair at a time kernels would, the lane's window column.
+                numOfFilledCells += (JInt)hi[lane] - (JInt)lo[lane] + 1;
+                JInt maxJ = tsJ[group[lane]]->size() - 1;
+                if (i == windows[group[lane]]->maxI()) {
+                    // The last column is never abandoned, its cost is the result.
+                    lanes.result(group[lane], maxJ >= lo[lane] && maxJ <= hi[lane] ? curr[maxJ*BATCH_LANES + lane]
+                                                                                     : outside);
+                }
+                else if (minCosts[lane] > cutoffs[lane]) {
+                    lanes.result(group[lane], abandonedDistance<double>());
+                }
+                else {
+                    continue;
+                }
+                active[lane] = false;
+                --numOfActive;
+            }
+
+            double* temp = last;
+            last = curr;
+            curr = temp;
+            currFrom = lastFrom;
+            currTo = lastTo;
+            lastFrom = from;
+            lastTo = to;
+        }
+        DTWStatistics::local().addCells(numOfFilledCells);
+    }
+
+    // Windowed DTW distances of tsI[lane] against tsJ[lane] within windows[lane], for count <= BATCH_LANES lanes.
+    //    The tsI[lane] have to be prefixes of one series, at least windows[lane]->maxI()+1 points long.
+    //    lanes.cutoff(lane) is asked for a lane's cutoff when the lane starts, and lanes.result(lane, distance) is
+    //    told its distance as soon as the lane is done. A lane is abandoned (its distance being abandonedDistance())
+    //    as soon as every cell of one of its columns costs more than its cutoff.
+    //    The lanes are grouped by groupBatch(); the groups of two or more lanes are filled together, and the lanes
+    //    left on their own are compared one after the other. Series and distance functions the batch kernels cannot
+    //    evaluate (see HasBatchKernel) compare every lane on its own.
+    template <typename ValueType, JInt nDimension, typename DistanceFunction, typename Lanes>
+    void getWarpDistsBetween(TimeSeries<ValueType,nDimension> const* const* tsI,
+                             TimeSeries<ValueType,nDimension> const* const* tsJ,
+                             SearchWindow const* const* windows, JInt count, DistanceFunction const& distFn,
+                             Lanes& lanes)
+    {
+        FDASSERT(count>=1 && count<=BATCH_LANES, "ERROR:  a batch of %ld series.",count);
+        JInt groups[BATCH_LANES][BATCH_LANES];
+        JInt groupSizes[BATCH_LANES];
+        JInt numOfGroups = 0;
+        if constexpr (HasBatchKernel<ValueType,nDimension,DistanceFunction>::value) {
+            for (JInt lane = 0; lane<count; ++lane) {
+                FDASSERT0(tsI[lane]->data() == tsI[0]->data(), "ERROR:  a batch compares prefixes of one time series.");
+                FDASSERT0(windows[lane]->maxI() < tsI[lane]->size(), "ERROR:  a search window wider than the time series.");
+            }
+            numOfGroups = groupBatch(windows, count, groups, groupSizes);
+            for (JInt g = 0; g<numOfGroups; ++g) {
+                if (groupSizes[g] > 1) {
+                    fillBatch(tsI, tsJ, windows, groups[g], groupSizes[g], lanes);
+                }
+            }
+        }
+        else {
+            for (JInt lane = 0; lane<count; ++lane) {
+                groups[numOfGroups][0] = lane;
+                groupSizes[numOfGroups++] = 1;
+            }
+        }
+        for (JInt g = 0; g<numOfGroups; ++g) {
+            if (groupSizes[g] == 1) {
+                JInt lane = groups[g][0];
+                ValueType cutoff = lanes.cutoff(lane);
+                lanes.result(lane, getWarpDistBetween(*tsI[lane], *tsJ[lane], *windows[lane], distFn, cutoff));
+            }
+        }
+    }
+}
+
+FD_NS_END
+#endif /* defined(__FastDTW_x__BatchDTW__) */
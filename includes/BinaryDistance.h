@@ -35,6 +35,19 @@ public:
         }
     }
     
+    // Distance between two points given as spans of nDimension values.
+    template <typename ValueType>
+    ValueType calcDistance(const ValueType* v1, const ValueType* v2, JInt nDimension) const
+    {
+        if (equal(v1, v1+nDimension, v2)) {
+            return (ValueType)0.0;
+        }
+        else
+        {
+            return (ValueType)1.0;
+        }
+    }
+    
     template <typename ValueType>
     ValueType calcDistance(const std::vector<ValueType>& v1, const std::vector<ValueType>& v2) const
     {
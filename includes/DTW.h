@@ -18,6 +18,9 @@
 #include "SearchWindow.h"
 #include "PartialWindowMatrix.h"
 #include "MemoryResidentMatrix.h"
+#include "Workspace.h"
+#include "DiagonalDTW.h"
+#include "DTWStatistics.h"
 #include <vector>
 #include <limits>
 FD_NS_START
@@ -31,51 +34,113 @@ namespace STRI {
         ValueType totalCost = 0.0;
         for (JInt p =0; p<path.size(); ++p) {
             ColMajorCell currWarp = path.get(p);
-            totalCost += distFn.calcDistance(*tsI.getMeasurementVector(currWarp.getCol()), *tsJ.getMeasurementVector(currWarp.getRow()));
+            totalCost += distFn.calcDistance(tsI.getMeasurements(currWarp.getCol()), tsJ.getMeasurements(currWarp.getRow()), tsI.numOfDimensions());
         }
         return totalCost;
     }
     
+    // Distance returned by the early-abandoning entry points when every warp path was found to cost more than the
+    //    cutoff.
+    template <typename ValueType>
+    inline ValueType abandonedDistance()
+    {
+        return numeric_limits<ValueType>::max();
+    }
+    
+    // Visitor of fillDiagonals() copying the cells into a cost matrix stored column after column, column i holding
+    //    rows lo[i]... from offsets[i] on.
+    template <typename ValueType>
+    struct StoreDiagonals
+    {
+        ValueType* matrix;
+        const JInt* offsets;
+        const JInt* lo;
+        
+        void operator()(JInt d, JInt first, JInt last, const ValueType* cells) const
+        {
+            for (JInt i = first; i<=last; ++i) {
+                matrix[offsets[i] + d - i - lo[i]] = cells[i];
+            }
+        }
+    };
+    
     // Dynamic Time Warping where the warp path is not needed, an alternate implementation can be used that does not
     //    require the entire cost matrix to be filled and only needs 2 columns to be stored at any one time.
+    //    Every warp path crosses every column and costs never decrease along a path, so the computation is abandoned
+    //    (returning abandonedDistance()) as soon as all cells of a column exceed cutoff.
+    //    1-D Euclidean series are filled by anti-diagonals instead (see fillDiagonals()), abandoned once two
+    //    consecutive anti-diagonals exceed cutoff.
     template <typename ValueType, JInt nDimension, typename DistanceFunction>
-    ValueType getWarpDistBetween(TimeSeries<ValueType, nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ, DistanceFunction const& distFn)
+    ValueType getWarpDistBetween(TimeSeries<ValueType, nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ, DistanceFunction const& distFn, ValueType cutoff)
     {
         // The space complexity is 2*tsJ.size().  Dynamic time warping is symmetric so switching the two time series
         //    parameters does not effect the final warp cost but can reduce the space complexity by allowing tsJ to
         //    be set as the shorter time series and only requiring 2 columns of size |tsJ| rather than 2 larger columns of
         //    size |tsI|.
         if (tsI.size() < tsJ.size()) {
-            return getWarpDistBetween(tsJ, tsI, distFn);
+            return getWarpDistBetween(tsJ, tsI, distFn, cutoff);
+        }
+        if constexpr (HasDiagonalKernel<ValueType,nDimension,DistanceFunction>::value) {
+            if (tsI.numOfDimensions() == 1) {
+                WorkspaceBuffer<JInt> lo(tsI.size(), 0);
+                WorkspaceBuffer<JInt> hi(tsI.size(), tsJ.size() - 1);
+                IgnoreDiagonals ignore;
+                ValueType distance;
+                if (!fillDiagonals(tsI.data(), tsI.size(), tsJ.data(), tsJ.size(), lo->data(), hi->data(), cutoff,
+                                   ignore, distance))
+                    return abandonedDistance<ValueType>();
+                return distance;
+            }
         }
-        vector<ValueType> lastColumn(tsJ.size());
-        vector<ValueType> currColumn(tsJ.size());
+        WorkspaceBuffer<ValueType> lastBuffer(tsJ.size());
+        WorkspaceBuffer<ValueType> currBuffer(tsJ.size());
+        DTWStatistics::local().addCostMatrix(2*tsJ.size()*(JLong)sizeof(ValueType));
+        vector<ValueType>& lastColumn = *lastBuffer;
+        vector<ValueType>& currColumn = *currBuffer;
         JInt maxI = tsI.size() - 1;
         JInt maxJ = tsJ.size() - 1;
         // Calculate the values for the first column, from the bottom up.
-        currColumn[0] = distFn.calcDistance(*tsI.getMeasurementVector(0), *tsJ.getMeasurementVector(0));
-        for (JInt j = 1; j<maxJ; ++j) {
-            currColumn[j] = currColumn[j-1] + distFn.calcDistance(*tsI.getMeasurementVector(0), *tsJ.getMeasurementVector(j));
+        currColumn[0] = distFn.calcDistance(tsI.getMeasurements(0), tsJ.getMeasurements(0), tsI.numOfDimensions());
+        for (JInt j = 1; j<=maxJ; ++j) {
+            currColumn[j] = currColumn[j-1] + distFn.calcDistance(tsI.getMeasurements(0), tsJ.getMeasurements(j), tsI.numOfDimensions());
+        }
+        // The first column is increasing from the bottom up, so its bottom cell is its minimum.
+        if (currColumn[0] > cutoff) {
+            DTWStatistics::local().addCells(tsJ.size());
+            return abandonedDistance<ValueType>();
         }
         vector<ValueType>* lastCol = &lastColumn;
         vector<ValueType>* currCol = &currColumn;
-        for (JInt i = 1; i<maxI; ++i) {
+        for (JInt i = 1; i<=maxI; ++i) {
             // Swap the references between the two arrays.
             vector<ValueType>* temp = lastCol;
             lastCol = currCol;
             currCol = temp;
             // Calculate the value for the bottom row of the current column
             //    (i,0) = LocalCost(i,0) + GlobalCost(i-1,0)
-            (*currCol)[0] = (*lastCol)[0] + distFn.calcDistance(*tsI.getMeasurementVector(i), *tsJ.getMeasurementVector(0));
+            (*currCol)[0] = (*lastCol)[0] + distFn.calcDistance(tsI.getMeasurements(i), tsJ.getMeasurements(0), tsI.numOfDimensions());
+            ValueType minColumnCost = (*currCol)[0];
             
-            for (int j=1; j<=maxJ; j++)  // j = rows
+            for (JInt j=1; j<=maxJ; j++)  // j = rows
             {
                 // (i,j) = LocalCost(i,j) + minGlobalCost{(i-1,j),(i-1,j-1),(i,j-1)}
-                ValueType minGlobalCost = fd_min(lastCol->at(j), fd_min(lastCol->at(j-1), currCol->at(j-1)));
-                (*currCol)[j] = minGlobalCost + distFn.calcDistance(*tsI.getMeasurementVector(i), *tsJ.getMeasurementVector(j));
+                ValueType minGlobalCost = fd_min((*lastCol)[j], fd_min((*lastCol)[j-1], (*currCol)[j-1]));
+                (*currCol)[j] = minGlobalCost + distFn.calcDistance(tsI.getMeasurements(i), tsJ.getMeasurements(j), tsI.numOfDimensions());
+                minColumnCost = fd_min(minColumnCost, (*currCol)[j]);
             }  // end for loop
+            if (minColumnCost > cutoff) {
+                DTWStatistics::local().addCells((i+1)*(JLong)tsJ.size());
+                return abandonedDistance<ValueType>();
+            }
         }
-        return currCol->at(maxJ);
+        DTWStatistics::local().addCells(tsI.size()*(JLong)tsJ.size());
+        return (*currCol)[maxJ];
+    }
+    
+    template <typename ValueType, JInt nDimension, typename DistanceFunction>
+    ValueType getWarpDistBetween(TimeSeries<ValueType, nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ, DistanceFunction const& distFn)
+    {
+        return getWarpDistBetween(tsI, tsJ, distFn, numeric_limits<ValueType>::max());
     }
     
     template <typename  ValueType, JInt nDimension, typename DistanceFunction>
@@ -91,48 +156,65 @@ namespace STRI {
         //     0 1 2 3 4 5 6
         //            i
         //   access is M(i,j)... column-row
-        vector<vector<ValueType> > costMatrix;
-        costMatrix.reserve(tsI.size());
+        // Stored column after column, cell (i,j) at i*jSize + j.
         JInt jSize = tsJ.size();
-        for (JInt i = 0; i<tsI.size(); ++i) {
-            costMatrix.push_back(vector<ValueType>(jSize));
-        }
+        WorkspaceBuffer<ValueType> costBuffer(tsI.size()*jSize);
+        DTWStatistics::local().addCostMatrix((JLong)tsI.size()*jSize*sizeof(ValueType));
+        vector<ValueType>& costMatrix = *costBuffer;
         JInt maxI = tsI.size() - 1;
         JInt maxJ = tsJ.size() - 1;
-        costMatrix[0][0] = distFn.calcDistance(*tsI.getMeasurementVector(0),
-                                               *tsJ.getMeasurementVector(0));
-        for (int j=1; j<=maxJ; j++)
-            costMatrix[0][j] = costMatrix[0][j-1] + distFn.calcDistance(*tsI.getMeasurementVector(0),
-                                                                        *tsJ.getMeasurementVector(j));
-        for (int i=1; i<=maxI; i++)   // i = columns
-        {
-            // Calculate the value for the bottom row of the current column
-            //    (i,0) = LocalCost(i,0) + GlobalCost(i-1,0)
-            costMatrix[i][0] = costMatrix[i-1][0] + distFn.calcDistance(*tsI.getMeasurementVector(i),
-                                                                        *tsJ.getMeasurementVector(0));
-            
-            for (int j=1; j<=maxJ; j++)  // j = rows
+        JBool filled = false;
+        if constexpr (HasDiagonalKernel<ValueType,nDimension,DistanceFunction>::value) {
+            if (tsI.numOfDimensions() == 1) {
+                WorkspaceBuffer<JInt> lo(tsI.size(), 0);
+                WorkspaceBuffer<JInt> hi(tsI.size(), maxJ);
+                WorkspaceBuffer<JInt> offsets(tsI.size());
+                for (JInt i = 0; i<=maxI; ++i) {
+                    (*offsets)[i] = i*jSize;
+                }
+                StoreDiagonals<ValueType> store = {costMatrix.data(), offsets->data(), lo->data()};
+                ValueType distance;
+                filled = fillDiagonals(tsI.data(), tsI.size(), tsJ.data(), tsJ.size(), lo->data(), hi->data(),
+                                       numeric_limits<ValueType>::max(), store, distance);
+            }
+        }
+        if (!filled) {
+            DTWStatistics::local().addCells(tsI.size()*(JLong)jSize);
+            costMatrix[0] = distFn.calcDistance(tsI.getMeasurements(0),
+                                                   tsJ.getMeasurements(0), tsI.numOfDimensions());
+            for (int j=1; j<=maxJ; j++)
+                costMatrix[j] = costMatrix[j-1] + distFn.calcDistance(tsI.getMeasurements(0),
+                                                                            tsJ.getMeasurements(j), tsI.numOfDimensions());
+            for (int i=1; i<=maxI; i++)   // i = columns
             {
-                // (i,j) = LocalCost(i,j) + minGlobalCost{(i-1,j),(i-1,j-1),(i,j-1)}
-                ValueType minGlobalCost = fd_min(costMatrix[i-1][j],
-                                              fd_min(costMatrix[i-1][j-1],
-                                                  costMatrix[i][j-1]));
-                costMatrix[i][j] = minGlobalCost + distFn.calcDistance(*tsI.getMeasurementVector(i),
-                                                                       *tsJ.getMeasurementVector(j));
+                // Calculate the value for the bottom row of the current column
+                //    (i,0) = LocalCost(i,0) + GlobalCost(i-1,0)
+                costMatrix[i*jSize + 0] = costMatrix[(i-1)*jSize + 0] + distFn.calcDistance(tsI.getMeasurements(i),
+                                                                            tsJ.getMeasurements(0), tsI.numOfDimensions());
+            
+                for (int j=1; j<=maxJ; j++)  // j = rows
+                {
+                    // (i,j) = LocalCost(i,j) + minGlobalCost{(i-1,j),(i-1,j-1),(i,j-1)}
+                    ValueType minGlobalCost = fd_min(costMatrix[(i-1)*jSize + j],
+                                                  fd_min(costMatrix[(i-1)*jSize + j-1],
+                                                      costMatrix[i*jSize + j-1]));
+                    costMatrix[i*jSize + j] = minGlobalCost + distFn.calcDistance(tsI.getMeasurements(i),
+                                                                           tsJ.getMeasurements(j), tsI.numOfDimensions());
+                }
             }
         }
-        ValueType minimumCost = costMatrix[maxI][maxJ];
-        WarpPath minCostPath(maxI + maxJ - 1);
+        ValueType minimumCost = costMatrix[maxI*jSize + maxJ];
+        WarpPath minCostPath(maxI + maxJ + 1);  // the longest possible path
         JInt i = maxI;
         JInt j = maxJ;
-        minCostPath.addFirst(i,j);
+        minCostPath.addLast(i,j);
         while (i>0 || j>0) {
             ValueType diagCost;
             ValueType leftCost;
             ValueType downCost;
             if ((i>0) && (j>0))
             {
-                diagCost = costMatrix[i-1][j-1];
+                diagCost = costMatrix[(i-1)*jSize + j-1];
             }
             else
             {
@@ -140,7 +222,7 @@ namespace STRI {
             }
             if (i > 0)
             {
-                leftCost = costMatrix[i-1][j];
+                leftCost = costMatrix[(i-1)*jSize + j];
             }
             else
             {
@@ -148,7 +230,7 @@ namespace STRI {
             }
             if (j > 0)
             {
-                downCost = costMatrix[i][j-1];
+                downCost = costMatrix[i*jSize + j-1];
             }
             else
             {
@@ -178,62 +260,144 @@ namespace STRI {
             {
                 i--;
             }
-            minCostPath.addFirst(i, j);
+            minCostPath.addLast(i, j);
         }
+        // The path was built backwards from (maxI,maxJ).
+        minCostPath.reverse();
         //Let Return Value Optimization do its job.
-        return TimeWarpInfo<ValueType>(minimumCost, minCostPath);
+        return TimeWarpInfo<ValueType>(minimumCost, std::move(minCostPath));
     }
     
-    template <typename  ValueType, JInt nDimension, typename DistanceFunction>
-    ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI,TimeSeries<ValueType,nDimension> const& tsJ,SearchWindow const& window, DistanceFunction const& distFn)
+    // Fills column i of a windowed cost matrix, rows lo...hi, into curr (curr[0] being row lo), given the previous
+    //    column in last (last[0] being row lastLo, up to row lastHi). Cells outside the window cost
+    //    numeric_limits<ValueType>::max(), and last is not read for i == 0. Returns the cheapest cell of the column.
+    //    The rows whose neighbours all lie inside the window run through a loop without any bounds checks.
+    template <typename ValueType, JInt nDimension, typename DistanceFunction>
+    inline ValueType fillWindowColumn(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ,
+                                      DistanceFunction const& distFn, JInt i, JInt lo, JInt hi, ValueType* curr,
+                                      const ValueType* last, JInt lastLo, JInt lastHi)
     {
-        //     COST MATRIX:
-        //   5|_|_|_|_|_|_|E| E = min Global Cost
-        //   4|_|_|_|_|_|_|_| S = Start point
-        //   3|_|_|_|_|_|_|_| each cell = min global cost to get to that point
-        // j 2|_|_|_|_|_|_|_|
-        //   1|_|_|_|_|_|_|_|
-        //   0|S|_|_|_|_|_|_|
-        //     0 1 2 3 4 5 6
-        //            i
-        //   access is M(i,j)... column-row
-        PartialWindowMatrix<ValueType> costMatrix(window);
-        JInt maxI = tsI.size()-1;
-        JInt maxJ = tsI.size() -1;
-        // Get an iterator that traverses the window cells in the order that the cost matrix is filled.
-        //    (first to last row (1..maxI), bottom to top (1..MaxJ)
-        SearchWindowIterator matrixIterator = window.iterator();
-        while (matrixIterator.hasNext()) {
-            ColMajorCell currentCell = matrixIterator.next();
-            JInt i = currentCell.getCol();
-            JInt j = currentCell.getRow();
-            if (i == 0 && j==0) { // bottom left cell (first row AND first column)
-                costMatrix.put(i,j,distFn.calcDistance(*tsI.getMeasurementVector(0),*tsJ.getMeasurementVector(0)));
+        const ValueType outside = numeric_limits<ValueType>::max();
+        const ValueType* pointI = tsI.getMeasurements(i);
+        const JInt dims = tsI.numOfDimensions();
+        // Cost of cell (i, j-1) while filling row j.
+        ValueType below = outside;
+        ValueType minColumnCost = outside;
+        JInt j = lo;
+        
+        if (i == 0)                      // first column
+        {
+            for (; j<=hi; ++j) {
+                ValueType cost = distFn.calcDistance(pointI, tsJ.getMeasurements(j), dims);
+                below = j == 0 ? cost : cost + below;
+                curr[j-lo] = below;
+                minColumnCost = fd_min(minColumnCost, below);
             }
-            else if (i == 0)             // first column
-            {
-                costMatrix.put(i, j, distFn.calcDistance(*tsI.getMeasurementVector(0), *tsJ.getMeasurementVector(j)) +
-                               costMatrix.get(i, j-1));
+            return minColumnCost;
+        }
+        
+        if (j == 0)                      // first row
+        {
+            ValueType left = lastLo == 0 && lastHi >= 0 ? last[0] : outside;
+            below = distFn.calcDistance(pointI, tsJ.getMeasurements(0), dims) + left;
+            curr[0] = below;
+            minColumnCost = below;
+            ++j;
+        }
+        
+        // Rows lastLo+1...lastHi see both of their neighbours in the last column.
+        JInt fastFrom = fd_max(j, lastLo + 1);
+        JInt fastTo = fd_min(hi, lastHi);
+        for (JInt pass = 0; pass<2; ++pass) {
+            JInt to = pass == 0 ? fd_min(hi, fastFrom - 1) : hi;
+            for (; j<=to; ++j) {
+                ValueType left = j >= lastLo && j <= lastHi ? last[j-lastLo] : outside;
+                ValueType diag = j-1 >= lastLo && j-1 <= lastHi ? last[j-1-lastLo] : outside;
+                ValueType minGlobalCost = fd_min(left, fd_min(diag, below));
+                below = minGlobalCost + distFn.calcDistance(pointI, tsJ.getMeasurements(j), dims);
+                curr[j-lo] = below;
+                minColumnCost = fd_min(minColumnCost, below);
             }
-            else if (j == 0)             // first row
-            {
-                costMatrix.put(i, j, distFn.calcDistance(*tsI.getMeasurementVector(i), *tsJ.getMeasurementVector(0)) +
-                               costMatrix.get(i-1, j));
+            if (pass == 0) {
+                // (i,j) = LocalCost(i,j) + minGlobalCost{(i-1,j),(i-1,j-1),(i,j-1)}
+                const ValueType* lastRow = last - lastLo;
+                ValueType* currRow = curr - lo;
+                for (; j<=fastTo; ++j) {
+                    ValueType minGlobalCost = fd_min(lastRow[j], fd_min(lastRow[j-1], below));
+                    below = minGlobalCost + distFn.calcDistance(pointI, tsJ.getMeasurements(j), dims);
+                    currRow[j] = below;
+                    minColumnCost = fd_min(minColumnCost, below);
+                }
             }
-            else                         // not first column or first row
-            {
-                ValueType minGlobalCost = fd_min(costMatrix.get(i-1, j),
-                                              fd_min(costMatrix.get(i-1, j-1),
-                                                  costMatrix.get(i, j-1)));
-                costMatrix.put(i, j, minGlobalCost + distFn.calcDistance(*tsI.getMeasurementVector(i),
-                                                                         *tsJ.getMeasurementVector(j)));
+        }
+        return minColumnCost;
+    }
+    
+    // Windowed Dynamic Time Warping where the warp path is not needed, only the current and the previous column of
+    //    the window are kept.  Abandoned (returning abandonedDistance()) as soon as every cell of a column costs more
+    //    than cutoff.  1-D Euclidean series are filled by anti-diagonals instead, as in the full version.
+    template <typename  ValueType, JInt nDimension, typename DistanceFunction>
+    ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI,TimeSeries<ValueType,nDimension> const& tsJ,SearchWindow const& window, DistanceFunction const& distFn, ValueType cutoff)
+    {
+        JInt maxI = tsI.size()-1;
+        JInt maxJ = tsJ.size()-1;
+        if constexpr (HasDiagonalKernel<ValueType,nDimension,DistanceFunction>::value) {
+            WorkspaceBuffer<JInt> lo(tsI.size());
+            WorkspaceBuffer<JInt> hi(tsI.size());
+            if (tsI.numOfDimensions() == 1 && diagonalBounds(window, maxI, maxJ, *lo, *hi)) {
+                IgnoreDiagonals ignore;
+                ValueType distance;
+                if (!fillDiagonals(tsI.data(), tsI.size(), tsJ.data(), tsJ.size(), lo->data(), hi->data(), cutoff,
+                                   ignore, distance))
+                    return abandonedDistance<ValueType>();
+                return distance;
             }
         }
-        return costMatrix.get(maxI,maxJ);
+        JInt height = 0;
+        for (JInt i = window.minI(); i<=window.maxI(); ++i) {
+            height = fd_max(height, window.maxJForI(i) - window.minJForI(i) + 1);
+        }
+        WorkspaceBuffer<ValueType> lastBuffer(height);
+        WorkspaceBuffer<ValueType> currBuffer(height);
+        DTWStatistics::local().addCostMatrix(2*height*(JLong)sizeof(ValueType));
+        vector<ValueType>& lastColumn = *lastBuffer;
+        vector<ValueType>& currColumn = *currBuffer;
+        JInt lastLo = 0;
+        JInt lastHi = -1;
+        JLong numOfCells = 0;
+        for (JInt i = window.minI(); i<=window.maxI(); ++i) {
+            lastColumn.swap(currColumn);
+            JInt lo = window.minJForI(i);
+            JInt hi = window.maxJForI(i);
+            ValueType minColumnCost = fillWindowColumn(tsI, tsJ, distFn, i, lo, hi, currColumn.data(),
+                                                       lastColumn.data(), lastLo, lastHi);
+            numOfCells += hi - lo + 1;
+            // The last column is never abandoned, its cost is the result.
+            if (minColumnCost > cutoff && i < window.maxI()) {
+                DTWStatistics::local().addCells(numOfCells);
+                return abandonedDistance<ValueType>();
+            }
+            lastLo = lo;
+            lastHi = hi;
+        }
+        DTWStatistics::local().addCells(numOfCells);
+        if (maxJ < lastLo || maxJ > lastHi || window.maxI() != maxI) {
+            return numeric_limits<ValueType>::max();
+        }
+        return currColumn[maxJ - lastLo];
     }
     
+    template <typename  ValueType, JInt nDimension, typename DistanceFunction>
+    ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI,TimeSeries<ValueType,nDimension> const& tsJ,SearchWindow const& window, DistanceFunction const& distFn)
+    {
+        return getWarpDistBetween(tsI, tsJ, window, distFn, numeric_limits<ValueType>::max());
+    }
+    
+    // Windowed Dynamic Time Warping with early abandoning: as soon as every cell of a column costs more than cutoff
+    //    the returned TimeWarpInfo carries abandonedDistance() and an empty warp path.  1-D Euclidean series are
+    //    filled by anti-diagonals instead, as in getWarpDistBetween().
     template <typename ValueType, JInt nDimension, typename DistanceFunction>
-    TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ,SearchWindow const& window, DistanceFunction const& distFn)
+    TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ,SearchWindow const& window, DistanceFunction const& distFn, ValueType cutoff)
     {
         //     COST MATRIX:
         //   5|_|_|_|_|_|_|E| E = min Global Cost
@@ -246,48 +410,49 @@ namespace STRI {
         //            i
         //   access is M(i,j)... column-row
         MemoryResidentMatrix<ValueType> costMatrix(&window);
+        DTWStatistics::local().addCostMatrix(window.size()*(JLong)sizeof(ValueType));
         JInt maxI = tsI.size()-1;
         JInt maxJ = tsJ.size()-1;
-        
-        // Get an iterator that traverses the window cells in the order that the cost matrix is filled.
-        //    (first to last row (1..maxI), bottom to top (1..MaxJ)
-        SearchWindowIterator matrixIterator = window.iterator();
-        
-        while (matrixIterator.hasNext())
-        {
-            ColMajorCell currentCell = matrixIterator.next();  // current cell being filled
-            JInt i = currentCell.getCol();
-            JInt j = currentCell.getRow();
-            
-            if ( (i==0) && (j==0) )      // bottom left cell (first row AND first column)
-                costMatrix.put(i, j, distFn.calcDistance(*tsI.getMeasurementVector(0), *tsJ.getMeasurementVector(0)));
-            else if (i == 0)             // first column
-            {
-                costMatrix.put(i, j, distFn.calcDistance(*tsI.getMeasurementVector(0), *tsJ.getMeasurementVector(j)) +
-                               costMatrix.get(i, j-1));
+        JBool filled = false;
+        if constexpr (HasDiagonalKernel<ValueType,nDimension,DistanceFunction>::value) {
+            WorkspaceBuffer<JInt> lo(tsI.size());
+            WorkspaceBuffer<JInt> hi(tsI.size());
+            if (tsI.numOfDimensions() == 1 && diagonalBounds(window, maxI, maxJ, *lo, *hi)) {
+                WorkspaceBuffer<JInt> offsets(tsI.size());
+                for (JInt i = 0; i<=maxI; ++i) {
+                    (*offsets)[i] = costMatrix.column(i) - costMatrix.column(0);
+                }
+                StoreDiagonals<ValueType> store = {costMatrix.column(0), offsets->data(), lo->data()};
+                ValueType distance;
+                if (!fillDiagonals(tsI.data(), tsI.size(), tsJ.data(), tsJ.size(), lo->data(), hi->data(), cutoff,
+                                   store, distance))
+                    return TimeWarpInfo<ValueType>(abandonedDistance<ValueType>(), WarpPath(0));
+                filled = true;
             }
-            else if (j == 0)             // first row
-            {
-                costMatrix.put(i, j, distFn.calcDistance(*tsI.getMeasurementVector(i), *tsJ.getMeasurementVector(0)) +
-                               costMatrix.get(i-1, j));
-            }
-            else                         // not first column or first row
-            {
-                ValueType minGlobalCost = fd_min(costMatrix.get(i-1, j),
-                                              fd_min(costMatrix.get(i-1, j-1),
-                                                  costMatrix.get(i, j-1)));
-                costMatrix.put(i, j, minGlobalCost + distFn.calcDistance(*tsI.getMeasurementVector(i),
-                                                                         *tsJ.getMeasurementVector(j)));
+        }
+        
+        // Fill the window column by column (first to last column (0..maxI), bottom to top (minJForI..maxJForI)).
+        JLong numOfCells = 0;
+        for (JInt i = window.minI(); !filled && i<=window.maxI(); ++i) {
+            JInt last = fd_max(i-1, window.minI());
+            ValueType minColumnCost = fillWindowColumn(tsI, tsJ, distFn, i, window.minJForI(i), window.maxJForI(i),
+                                                       costMatrix.column(i), costMatrix.column(last),
+                                                       window.minJForI(last), window.maxJForI(last));
+            numOfCells += window.maxJForI(i) - window.minJForI(i) + 1;
+            if (minColumnCost > cutoff && i < window.maxI()) {
+                DTWStatistics::local().addCells(numOfCells);
+                return TimeWarpInfo<ValueType>(abandonedDistance<ValueType>(), WarpPath(0));
             }
         }
+        DTWStatistics::local().addCells(numOfCells);
         
         // Minimum Cost is at (maxI, maxJ)
         ValueType minimumCost = costMatrix.get(maxI, maxJ);
         
-        WarpPath minCostPath(maxI+maxJ-1);
+        WarpPath minCostPath(maxI+maxJ+1);  // the longest possible path
         JInt i = maxI;
         JInt j = maxJ;
-        minCostPath.addFirst(i, j);
+        minCostPath.addLast(i, j);
         while ((i>0) || (j>0))
         {
             // Find the costs of moving in all three possible directions (left,
@@ -328,10 +493,18 @@ namespace STRI {
                 i--;
             
             // Add the current step to the warp path.
-            minCostPath.addFirst(i, j);
+            minCostPath.addLast(i, j);
         }
         
-        return TimeWarpInfo<ValueType>(minimumCost, minCostPath);
+        // The path was built backwards from (maxI,maxJ).
+        minCostPath.reverse();
+        return TimeWarpInfo<ValueType>(minimumCost, std::move(minCostPath));
+    }
+    
+    template <typename ValueType, JInt nDimension, typename DistanceFunction>
+    TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ,SearchWindow const& window, DistanceFunction const& distFn)
+    {
+        return getWarpInfoBetween(tsI, tsJ, window, distFn, numeric_limits<ValueType>::max());
     }
 }
 
@@ -0,0 +1,95 @@
+//
+//  DTWStatistics.h
+//  FastDTW-x
+//
+
+#ifndef __FastDTW_x__DTWStatistics__
+#define __FastDTW_x__DTWStatistics__
+
+#include "Foundation.h"
+#include "FDMath.h"
+#include <cstring>
+
+FD_NS_START
+
+// Levels of a PAA pyramid of a series of up to 2^32 points.
+const JInt STATISTICS_MAX_LEVELS = 32;
+
+// Per thread tally of the dynamic programming work done, for profiling. A caller resets it before a comparison (or a
+//    batch of them) and reads it afterwards. The passes are counted by the resolution they ran at, level 0 being the
+//    full resolution and level l the l-th coarser one of FastDTW. A pass is recorded with addPass() right before a
+//    kernel fills it, and the kernel adds the cells it actually filled with addCells(), so a pass abandoned after a
+//    few columns only counts those columns.
+class DTWStatistics
+{
+public:
+    JLong passes[STATISTICS_MAX_LEVELS];
+    // Cells the kernels filled.
+    JLong cells[STATISTICS_MAX_LEVELS];
+    // Cells of the passes' search windows, filled or not.
+    JLong windowCells[STATISTICS_MAX_LEVELS];
+    // Largest search window of a single pass at each level.
+    JLong maxWindowCells[STATISTICS_MAX_LEVELS];
+    // Bytes of the largest cost matrix storage (whole matrix, two columns or three anti-diagonals) of a pass.
+    JLong peakCostMatrixBytes;
+
+    DTWStatistics()
+    {
+        reset();
+    }
+
+    static DTWStatistics& local()
+    {
+        static thread_local DTWStatistics statistics;
+        return statistics;
+    }
+
+    void reset()
+    {
+        memset(passes, 0, sizeof(passes));
+        memset(cells, 0, sizeof(cells));
+        memset(windowCells, 0, sizeof(windowCells));
+        memset(maxWindowCells, 0, sizeof(maxWindowCells));
+        peakCostMatrixBytes = 0;
+        _level = 0;
+    }
+
+    // A pass at level over a search window of numOfWindowCells cells.
+    void addPass(JInt level, JLong numOfWindowCells)
+    {
+        _level = fd_min(level, STATISTICS_MAX_LEVELS - 1);
+        ++passes[_level];
+        windowCells[_level] += numOfWindowCells;
+        maxWindowCells[_level] = fd_max(maxWindowCells[_level], numOfWindowCells);
+    }
+
+    // Cells filled by a kernel, counted at the level of the last pass recorded.
+    void addCells(JLong numOfCells)
+    {
+        cells[_level] += numOfCells;
+    }
+
+    void addCostMatrix(JLong bytes)
+    {
+        peakCostMatrixBytes = fd_max(peakCostMatrixBytes, bytes);
+    }
+
+    // Adds the work tallied in other, e.g. by another thread.
+    void merge(const DTWStatistics& other)
+    {
+        for (JInt level = 0; level<STATISTICS_MAX_LEVELS; ++level) {
+            passes[level] += other.passes[level];
+            cells[level] += other.cells[level];
+            windowCells[level] += other.windowCells[level];
+            maxWindowCells[level] = fd_max(maxWindowCells[level], other.maxWindowCells[level]);
+        }
+        peakCostMatrixBytes = fd_max(peakCostMatrixBytes, other.peakCostMatrixBytes);
+    }
+
+private:
+    // Level of the last pass recorded, which addCells() counts towards.
+    JInt _level;
+};
+
+FD_NS_END
+#endif /* defined(__FastDTW_x__DTWStatistics__) */
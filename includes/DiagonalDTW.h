@@ -0,0 +1,325 @@
+//
+//  DiagonalDTW.h
+//  FastDTW-x
+//
+
+#ifndef __FastDTW_x__DiagonalDTW__
+#define __FastDTW_x__DiagonalDTW__
+
+#include "Foundation.h"
+#include "FDMath.h"
+#include "EuclideanDistance.h"
+#include "SearchWindow.h"
+#include "Workspace.h"
+#include "DTWStatistics.h"
+#include <vector>
+#include <limits>
+#include <cmath>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FD_DIAGONAL_X86 1
+#endif
+
+FD_NS_START
+
+// Anti-diagonal (wavefront) evaluation of the DTW cost matrix. Cell (i,j) only depends on cells of the anti-diagonals
+//    i+j-1 and i+j-2, so the cells of one anti-diagonal are independent of each other and are filled several at a
+//    time: with AVX-512 or AVX2 lanes when the CPU has them (checked once, at the first use), otherwise with scalar
+//    code. float series fit twice as many cells in a vector as double ones. Every cell is computed with the same
+//    operations on the same operands as in the column kernels, only in another order, so the distances and warp
+//    paths are bit for bit the same.
+namespace STRI {
+    using namespace std;
+
+    // Whether the anti-diagonal kernels can evaluate the local cost of DistanceFunction on points of
+    //    TimeSeries<ValueType,nDimension>. Only 1-D double or float points under the Euclidean distance, i.e. |a-b|,
+    //    computed as EuclideanDistance does it, see euclideanCost().
+    template <typename ValueType, JInt nDimension, typename DistanceFunction>
+    struct HasDiagonalKernel
+    {
+        static const JBool value = false;
+    };
+
+    template <>
+    struct HasDiagonalKernel<double, 1, EuclideanDistance>
+    {
+        static const JBool value = true;
+    };
+
+    template <>
+    struct HasDiagonalKernel<float, 1, EuclideanDistance>
+    {
+        static const JBool value = true;
+    };
+
+    // EuclideanDistance's cost of two points diff apart. For double it is sqrt(diff*diff); for float the square and
+    //    the root are taken in double, where both are exact, so the result is exactly |diff|.
+    inline double euclideanCost(double diff)
+    {
+        return sqrt(diff*diff);
+    }
+
+    inline float euclideanCost(float diff)
+    {
+        return fabs(diff);
+    }
+
+    // Fills count cells of an anti-diagonal: out[k] = min(left[k], diag[k], below[k]) + |a[k]-b[k]|, where b runs
+    //    along tsJ backwards. Returns the minimum of minCost and of the cells filled.
+    template <typename ValueType>
+    struct DiagonalRun
+    {
+        typedef ValueType (*Function)(const ValueType* a, const ValueType* b, const ValueType* left,
+                                      const ValueType* diag, const ValueType* below, ValueType* out, JInt count,
+                                      ValueType minCost);
+    };
+
+    template <typename ValueType>
+    inline ValueType diagonalRunScalar(const ValueType* a, const ValueType* b, const ValueType* left,
+                                       const ValueType* diag, const ValueType* below, ValueType* out, JInt count,
+                                       ValueType minCost)
+    {
+        for (JInt k = 0; k<count; ++k) {
+            ValueType cost = fd_min(left[k], fd_min(diag[k], below[k])) + euclideanCost(a[k] - b[k]);
+            out[k] = cost;
+            minCost = fd_min(minCost, cost);
+        }
+        return minCost;
+    }
+
+#ifdef FD_DIAGONAL_X86
+    __attribute__((target("avx2")))
+    inline double diagonalRunAVX2(const double* a, const double* b, const double* left, const double* diag,
+                                  const double* below, double* out, JInt count, double minCost)
+    {
+        __m256d minCosts = _mm256_set1_pd(minCost);
+        JInt k = 0;
+        for (; k+4<=count; k+=4) {
+            __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a+k), _mm256_loadu_pd(b+k));
+            __m256d minGlobalCost = _mm256_min_pd(_mm256_loadu_pd(left+k),
+                                                  _mm256_min_pd(_mm256_loadu_pd(diag+k), _mm256_loadu_pd(below+k)));
+            __m256d cost = _mm256_add_pd(minGlobalCost, _mm256_sqrt_pd(_mm256_mul_pd(diff, diff)));
+            _mm256_storeu_pd(out+k, cost);
+            minCosts = _mm256_min_pd(minCosts, cost);
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, minCosts);
+        minCost = fd_min(fd_min(lanes[0], lanes[1]), fd_min(lanes[2], lanes[3]));
+        return diagonalRunScalar(a+k, b+k, left+k, diag+k, below+k, out+k, count-k, minCost);
+    }
+
+    __attribute__((target("avx2")))
+    inline float diagonalRunAVX2(const float* a, const float* b, const float* left, const float* diag,
+                                 const float* below, float* out, JInt count, float minCost)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        __m256 minCosts = _mm256_set1_ps(minCost);
+        JInt k = 0;
+        for (; k+8<=count; k+=8) {
+            __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a+k), _mm256_loadu_ps(b+k));
+            __m256 minGlobalCost = _mm256_min_ps(_mm256_loadu_ps(left+k),
+                                                 _mm256_min_ps(_mm256_loadu_ps(diag+k), _mm256_loadu_ps(below+k)));
+            __m256 cost = _mm256_add_ps(minGlobalCost, _mm256_andnot_ps(sign, diff));
+            _mm256_storeu_ps(out+k, cost);
+            minCosts = _mm256_min_ps(minCosts, cost);
+        }
+        float lanes[8];
+        _mm256_storeu_ps(lanes, minCosts);
+        for (JInt lane = 0; lane<8; ++lane) {
+            minCost = fd_min(minCost, lanes[lane]);
+        }
+        return diagonalRunScalar(a+k, b+k, left+k, diag+k, below+k, out+k, count-k, minCost);
+    }
+
+    // GCC's AVX-512 intrinsics start from deliberately undefined registers, which -Wall reports.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f")))
+    inline double diagonalRunAVX512(const double* a, const double* b, const double* left, const double* diag,
+                                    const double* below, double* out, JInt count, double minCost)
+    {
+        __m512d minCosts = _mm512_set1_pd(minCost);
+        JInt k = 0;
+        for (; k+8<=count; k+=8) {
+            __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(a+k), _mm512_loadu_pd(b+k));
+            __m512d minGlobalCost = _mm512_min_pd(_mm512_loadu_pd(left+k),
+                                                  _mm512_min_pd(_mm512_loadu_pd(diag+k), _mm512_loadu_pd(below+k)));
+            __m512d cost = _mm512_add_pd(minGlobalCost, _mm512_sqrt_pd(_mm512_mul_pd(diff, diff)));
+            _mm512_storeu_pd(out+k, cost);
+            minCosts = _mm512_min_pd(minCosts, cost);
+        }
+        minCost = _mm512_reduce_min_pd(minCosts);
+        return diagonalRunScalar(a+k, b+k, left+k, diag+k, below+k, out+k, count-k, minCost);
+    }
+
+    __attribute__((target("avx512f")))
+    inline float diagonalRunAVX512(const float* a, const float* b, const float* left, const float* diag,
+                                   const float* below, float* out, JInt count, float minCost)
+    {
+        __m512 minCosts = _mm512_set1_ps(minCost);
+        JInt k = 0;
+        for (; k+16<=count; k+=16) {
+            __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(a+k), _mm512_loadu_ps(b+k));
+            __m512 minGlobalCost = _mm512_min_ps(_mm512_loadu_ps(left+k),
+                                                 _mm512_min_ps(_mm512_loadu_ps(diag+k), _mm512_loadu_ps(below+k)));
+            __m512 cost = _mm512_add_ps(minGlobalCost, _mm512_abs_ps(diff));
+            _mm512_storeu_ps(out+k, cost);
+            minCosts = _mm512_min_ps(minCosts, cost);
+        }
+        minCost = _mm512_reduce_min_ps(minCosts);
+        return diagonalRunScalar(a+k, b+k, left+k, diag+k, below+k, out+k, count-k, minCost);
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    // The widest kernel the CPU supports.
+    template <typename ValueType>
+    inline typename DiagonalRun<ValueType>::Function selectDiagonalRun()
+    {
+        typedef typename DiagonalRun<ValueType>::Function Function;
+#ifdef FD_DIAGONAL_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return (Function)diagonalRunAVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return (Function)diagonalRunAVX2;
+#endif
+        return diagonalRunScalar<ValueType>;
+    }
+
+    template <typename ValueType>
+    inline typename DiagonalRun<ValueType>::Function diagonalRun()
+    {
+        static const typename DiagonalRun<ValueType>::Function run = selectDiagonalRun<ValueType>();
+        return run;
+    }
+
+    // Least average number of rows per column of a window filled by anti-diagonals. A narrower window (a thin
+    //    Sakoe-Chiba band, say) crosses each anti-diagonal in too few cells to fill the vectors, and the column
+    //    kernels are faster there.
+    const JInt DIAGONAL_MIN_HEIGHT = 24;
+
+    // Copies the row bounds of window into lo and hi, one entry per column. Returns false unless the window starts at
+    //    (0,0), ends at (maxI,maxJ) and its bounds never decrease from one column to the next, the shape that makes
+    //    every anti-diagonal cross the window in a single run of cells, and is at least DIAGONAL_MIN_HEIGHT rows high
+    //    on average. FastDTW's windows always have that shape, the others are left to the column kernels.
+    inline JBool diagonalBounds(SearchWindow const& window, JInt maxI, JInt maxJ, vector<JInt>& lo, vector<JInt>& hi)
+    {
+        if (window.minI() != 0 || window.maxI() != maxI || window.size() < DIAGONAL_MIN_HEIGHT*(maxI + 1)) {
+            return false;
+        }
+        for (JInt i = 0; i<=maxI; ++i) {
+            lo[i] = window.minJForI(i);
+            hi[i] = window.maxJForI(i);
+            if (lo[i] > hi[i] || (i > 0 && (lo[i] < lo[i-1] || hi[i] < hi[i-1]))) {
+                return false;
+            }
+        }
+        return lo[0] == 0 && hi[maxI] == maxJ;
+    }
+
+    // Fills the cost matrix of the 1-D series a (size n, the columns) and b (size m, the rows) restricted to rows
+    //    lo[i]...hi[i] of every column i (bounds as accepted by diagonalBounds()), one anti-diagonal after the other.
+    //    Cells outside the bounds cost numeric_limits<ValueType>::max(), as in fillWindowColumn(). After filling
+    //    anti-diagonal d, whose cells are (i,d-i) for i = first...last, calls visit(d, first, last, cells) with
+    //    cells[i] the cost of cell (i,d-i).
+    //    Every warp path has a cell on one of any two consecutive anti-diagonals, so the computation is abandoned as
+    //    soon as two consecutive anti-diagonals (other than the last) cost more than cutoff. Returns false when
+    //    abandoned, otherwise stores the cost of (n-1,m-1) in distance. The cells of the anti-diagonals reached are
+    //    added to DTWStatistics.
+    template <typename ValueType, typename Visitor>
+    JBool fillDiagonals(const ValueType* a, JInt n, const ValueType* b, JInt m, const JInt* lo, const JInt* hi,
+                        ValueType cutoff, Visitor& visit, ValueType& distance)
+    {
+        const ValueType outside = numeric_limits<ValueType>::max();
+        const typename DiagonalRun<ValueType>::Function run = diagonalRun<ValueType>();
+        // b backwards, so that the rows of an anti-diagonal's cells are consecutive: row d-i is reversed[m-1-d+i].
+        WorkspaceBuffer<ValueType> reversedBuffer(m);
+        vector<ValueType>& reversed = *reversedBuffer;
+        for (JInt j = 0; j<m; ++j) {
+            reversed[j] = b[m-1-j];
+        }
+        // The last three anti-diagonals, each indexed by column; cells first...last of each are valid.
+        WorkspaceBuffer<ValueType> buffer0(n);
+        WorkspaceBuffer<ValueType> buffer1(n);
+        WorkspaceBuffer<ValueType> buffer2(n);
+        DTWStatistics::local().addCostMatrix(3*n*(JLong)sizeof(ValueType));
+        ValueType* prev2 = buffer0->data();
+        ValueType* prev1 = buffer1->data();
+        ValueType* curr = buffer2->data();
+        JInt first2 = 0, last2 = -1;
+        JInt first1 = 0, last1 = -1;
+        ValueType lastMinCost = outside;
+        JInt first = 0;
+        JInt last = -1;
+        JLong numOfCells = 0;
+        const JInt numOfDiagonals = n + m - 1;
+        for (JInt d = 0; d<numOfDiagonals; ++d) {
+            // The bounds are non-decreasing, so both ends of the run only move forward.
+            while (first < n && hi[first] + first < d) {
+                ++first;
+            }
+            while (last+1 < n && lo[last+1] + last+1 <= d) {
+                ++last;
+            }
+            const JInt rowOffset = m-1-d;
+            ValueType minCost = outside;
+            if (d == 0) {
+                curr[0] = euclideanCost(a[0] - b[0]);
+                minCost = curr[0];
+            }
+            else {
+                // Cells first...last, the ones whose neighbours all lie in the previous two anti-diagonals take the
+                //    vector kernel, the others are checked one by one.
+                JInt fastFrom = fd_max(first, fd_max(first1, first2) + 1);
+                JInt fastTo = fd_min(last, fd_min(last1, last2 + 1));
+                JInt i = first;
+                for (JInt pass = 0; pass<2; ++pass) {
+                    JInt to = pass == 0 && fastFrom <= fastTo ? fastFrom - 1 : last;
+                    for (; i<=to; ++i) {
+                        ValueType left = i-1 >= first1 && i-1 <= last1 ? prev1[i-1] : outside;
+                        ValueType diag = i-1 >= first2 && i-1 <= last2 ? prev2[i-1] : outside;
+                        ValueType below = i >= first1 && i <= last1 ? prev1[i] : outside;
+                        curr[i] = fd_min(left, fd_min(diag, below)) + euclideanCost(a[i] - reversed[rowOffset+i]);
+                        minCost = fd_min(minCost, curr[i]);
+                    }
+                    if (pass == 0 && fastFrom <= fastTo) {
+                        minCost = run(a+i, reversed.data()+rowOffset+i, prev1+i-1, prev2+i-1, prev1+i, curr+i, fastTo-i+1, minCost);
+                        i = fastTo + 1;
+                    }
+                }
+            }
+            visit(d, first, last, (const ValueType*)curr);
+            numOfCells += last - first + 1;
+            if (minCost > cutoff && lastMinCost > cutoff && d < numOfDiagonals-1) {
+                DTWStatistics::local().addCells(numOfCells);
+                return false;
+            }
+            lastMinCost = minCost;
+            ValueType* temp = prev2;
+            prev2 = prev1;
+            prev1 = curr;
+            curr = temp;
+            first2 = first1;
+            last2 = last1;
+            first1 = first;
+            last1 = last;
+        }
+        DTWStatistics::local().addCells(numOfCells);
+        distance = first1 <= n-1 && last1 >= n-1 ? prev1[n-1] : outside;
+        return true;
+    }
+
+    // Visitor of fillDiagonals() for when only the distance is needed.
+    struct IgnoreDiagonals
+    {
+        template <typename ValueType>
+        void operator()(JInt, JInt, JInt, const ValueType*) const
+        {
+        }
+    };
+}
+
+FD_NS_END
+#endif /* defined(__FastDTW_x__DiagonalDTW__) */
@@ -35,6 +35,17 @@ public:
         return (ValueType)sqrt(sqSum);
     }
     
+    // Distance between two points given as spans of nDimension values.
+    template <typename ValueType>
+    ValueType calcDistance(const ValueType* v1, const ValueType* v2, JInt nDimension) const
+    {
+        double sqSum = 0.0;
+        for (JInt i = 0; i<nDimension; ++i) {
+            sqSum+= pow((double)(v1[i]-v2[i]), 2.0);
+        }
+        return (ValueType)sqrt(sqSum);
+    }
+    
     template <typename ValueType>
     ValueType calcDistance(const std::vector<ValueType>& v1, const std::vector<ValueType>& v2) const
     {
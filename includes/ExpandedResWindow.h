@@ -69,8 +69,7 @@ public:
             //    higher resolution.
             for (int x=0; x<blockISize; x++)
             {
-                SearchWindow::markVisited(currentI+x, currentJ);
-                SearchWindow::markVisited(currentI+x, currentJ+blockJSize-1);
+                SearchWindow::markVisited(currentI+x, currentJ, currentJ+blockJSize-1);
             }  // end for loop
             
             // Record the last position in the warp path so the direction of the path can be determined when the next
@@ -12,7 +12,12 @@
 #include "Foundation.h"
 #include "DTW.h"
 #include "PAA.h"
+#include "PAAPyramid.h"
 #include "ExpandedResWindow.h"
+#include "FullWindow.h"
+#include "BatchDTW.h"
+#include "DTWStatistics.h"
+#include <optional>
 
 //#include "TimeWarpInfo.h"
 //#include "TimeSeries.h"
@@ -23,36 +28,158 @@ namespace FAST {
     
     extern const JInt DEFAULT_SEARCH_RADIUS;
     
+    // The next coarser resolution of ts, which is the series at the given level of pyramid (0 being the full
+    //    resolution). Taken from pyramid if there is one, otherwise built into storage from the thread's workspace.
+    template <typename ValueType,JInt nDimension>
+    inline PAA<ValueType,nDimension> const& shrink(TimeSeries<ValueType,nDimension> const& ts, PAAPyramid<ValueType,nDimension> const* pyramid,
+                                                   JInt level, optional<PAA<ValueType,nDimension> >& storage)
+    {
+        if (pyramid) {
+            return pyramid->getLevel(level+1);
+        }
+        JDouble resolutionFactor = 2.0;
+        storage.emplace(ts,(JInt)(ts.size()/resolutionFactor),true);
+        return *storage;
+    }
+    
+    // tsI and tsJ are the series at the given level of pyramidI and pyramidJ. A NULL pyramid has its levels built on
+    //    the fly.
+    // The cutoff only applies to the full resolution pass; the coarser passes have to finish to provide the warp
+    //    path that the next window is projected from, and their costs do not bound the full resolution cost.
     template <typename ValueType,JInt nDimension, typename DistanceFunction>
-    TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ, JInt searchRadius, DistanceFunction const& distFn)
+    TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, PAAPyramid<ValueType,nDimension> const* pyramidI,
+                                               TimeSeries<ValueType,nDimension> const& tsJ, PAAPyramid<ValueType,nDimension> const* pyramidJ,
+                                               JInt level, JInt searchRadius, DistanceFunction const& distFn, ValueType cutoff)
     {
         if (searchRadius < 0) {
             searchRadius = 0;
         }
         JInt minTSsize = searchRadius + 2;
         if (tsI.size() <= minTSsize || tsJ.size()<=minTSsize) {
+            DTWStatistics::local().addPass(level, (JLong)tsI.size()*tsJ.size());
             return STRI::getWarpInfoBetween(tsI, tsJ, distFn);
         }
         else
         {
-            JDouble resolutionFactor = 2.0;
-            PAA<ValueType,nDimension> shrunkI(tsI,(JInt)(tsI.size()/resolutionFactor));
-            PAA<ValueType,nDimension> shrunkJ(tsJ,(JInt)(tsJ.size()/resolutionFactor));
+            optional<PAA<ValueType,nDimension> > storageI, storageJ;
+            PAA<ValueType,nDimension> const& shrunkI = shrink(tsI, pyramidI, level, storageI);
+            PAA<ValueType,nDimension> const& shrunkJ = shrink(tsJ, pyramidJ, level, storageJ);
             // Determine the search window that constrains the area of the cost matrix that will be evaluated based on
             //    the warp path found at the previous resolution (smaller time series).
-            TimeWarpInfo<ValueType> warpInfo = getWarpInfoBetween(shrunkI, shrunkJ, searchRadius, distFn);
+            TimeWarpInfo<ValueType> warpInfo = getWarpInfoBetween(shrunkI, pyramidI, shrunkJ, pyramidJ, level+1,
+                                                                   searchRadius, distFn, numeric_limits<ValueType>::max());
             ExpandedResWindow window(tsI, tsJ, shrunkI, shrunkJ,
                                      *(warpInfo.getPath()),
                                      searchRadius);
-            return STRI::getWarpInfoBetween(tsI, tsJ, window, distFn);
+            DTWStatistics::local().addPass(level, window.size());
+            return STRI::getWarpInfoBetween(tsI, tsJ, window, distFn, cutoff);
         }
         
     }
     
+    template <typename ValueType,JInt nDimension, typename DistanceFunction>
+    inline TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ, JInt searchRadius, DistanceFunction const& distFn, ValueType cutoff)
+    {
+        return getWarpInfoBetween(tsI, (PAAPyramid<ValueType,nDimension> const*)NULL, tsJ, (PAAPyramid<ValueType,nDimension> const*)NULL,
+                                  0, searchRadius, distFn, cutoff);
+    }
+    
+    template <typename ValueType,JInt nDimension, typename DistanceFunction>
+    inline TimeWarpInfo<ValueType> getWarpInfoBetween(TimeSeries<ValueType,nDimension> const& tsI, TimeSeries<ValueType,nDimension> const& tsJ, JInt searchRadius, DistanceFunction const& distFn)
+    {
+        return getWarpInfoBetween(tsI, tsJ, searchRadius, distFn, numeric_limits<ValueType>::max());
+    }
+    
+    // Builds into window the search window of the full resolution pass of tsI against tsJ: the warp path found at
+    //    the next coarser resolution, projected to the full resolution and expanded by searchRadius. The series have
+    //    to be longer than searchRadius+2.
+    template <typename ValueType,JInt nDimension, typename DistanceFunction>
+    void projectSearchWindow(TimeSeries<ValueType,nDimension> const& tsI, PAAPyramid<ValueType,nDimension> const* pyramidI,
+                             TimeSeries<ValueType,nDimension> const& tsJ, PAAPyramid<ValueType,nDimension> const* pyramidJ,
+                             JInt searchRadius, DistanceFunction const& distFn, optional<ExpandedResWindow>& window)
+    {
+        optional<PAA<ValueType,nDimension> > storageI, storageJ;
+        PAA<ValueType,nDimension> const& shrunkI = shrink(tsI, pyramidI, 0, storageI);
+        PAA<ValueType,nDimension> const& shrunkJ = shrink(tsJ, pyramidJ, 0, storageJ);
+        TimeWarpInfo<ValueType> warpInfo = getWarpInfoBetween(shrunkI, pyramidI, shrunkJ, pyramidJ, 1,
+                                                               searchRadius, distFn, numeric_limits<ValueType>::max());
+        window.emplace(tsI, tsJ, shrunkI, shrunkJ, *(warpInfo.getPath()), searchRadius);
+    }
+    
+    // Distance only FastDTW. The coarser resolutions still need their warp paths to project the next search window,
+    //    but the full resolution pass only keeps two columns of the cost matrix and never backtracks a warp path.
+    //    Gives up (returning STRI::abandonedDistance()) once the warp cost is known to exceed cutoff.
+    // pyramidI and pyramidJ, if not NULL, hold the coarser resolutions of tsI and tsJ, which saves rebuilding them
+    //    for every comparison.
+    template <typename ValueType,JInt nDimension, typename DistanceFunction>
+    ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI, PAAPyramid<ValueType,nDimension> const* pyramidI,
+                                 TimeSeries<ValueType,nDimension> const& tsJ, PAAPyramid<ValueType,nDimension> const* pyramidJ,
+                                 JInt searchRadius,DistanceFunction const& distFn, ValueType cutoff)
+    {
+        FDASSERT0(!pyramidI || pyramidI->originalSize() == tsI.size(), "ERROR:  the PAA pyramid was built from a different time series.");
+        FDASSERT0(!pyramidJ || pyramidJ->originalSize() == tsJ.size(), "ERROR:  the PAA pyramid was built from a different time series.");
+        if (searchRadius < 0) {
+            searchRadius = 0;
+        }
+        JInt minTSsize = searchRadius + 2;
+        if (tsI.size() <= minTSsize || tsJ.size()<=minTSsize) {
+            DTWStatistics::local().addPass(0, (JLong)tsI.size()*tsJ.size());
+            return STRI::getWarpDistBetween(tsI, tsJ, distFn, cutoff);
+        }
+        else
+        {
+            optional<ExpandedResWindow> window;
+            projectSearchWindow(tsI, pyramidI, tsJ, pyramidJ, searchRadius, distFn, window);
+            DTWStatistics::local().addPass(0, window->size());
+            return STRI::getWarpDistBetween(tsI, tsJ, *window, distFn, cutoff);
+        }
+    }
+    
+    // Distance only FastDTW of tsI[lane] against tsJ[lane] for count <= STRI::BATCH_LANES lanes, reported through
+    //    lanes.cutoff(lane) and lanes.result(lane, distance) as in STRI::getWarpDistsBetween(). The tsI[lane] have to
+    //    be prefixes of one series. The coarser resolutions are compared one pair at a time, then the full resolution
+    //    passes go to STRI::getWarpDistsBetween(), which fills the lanes whose windows line up together. Pairs too
+    //    short to shrink take part with the whole cost matrix as their window.
+    template <typename ValueType,JInt nDimension, typename DistanceFunction, typename Lanes>
+    void getWarpDistsBetween(TimeSeries<ValueType,nDimension> const* const* tsI, PAAPyramid<ValueType,nDimension> const* const* pyramidI,
+                             TimeSeries<ValueType,nDimension> const* const* tsJ, PAAPyramid<ValueType,nDimension> const* const* pyramidJ,
+                             JInt count, JInt searchRadius, DistanceFunction const& distFn, Lanes& lanes)
+    {
+        FDASSERT(count>=1 && count<=STRI::BATCH_LANES, "ERROR:  a batch of %ld series.",count);
+        if (searchRadius < 0) {
+            searchRadius = 0;
+        }
+        JInt minTSsize = searchRadius + 2;
+        optional<ExpandedResWindow> expanded[STRI::BATCH_LANES];
+        optional<FullWindow> full[STRI::BATCH_LANES];
+        SearchWindow const* windows[STRI::BATCH_LANES];
+        for (JInt lane = 0; lane<count; ++lane) {
+            if (tsI[lane]->size() <= minTSsize || tsJ[lane]->size() <= minTSsize) {
+                full[lane].emplace(*tsI[lane], *tsJ[lane]);
+                windows[lane] = &*full[lane];
+            }
+            else {
+                projectSearchWindow(*tsI[lane], pyramidI[lane], *tsJ[lane], pyramidJ[lane], searchRadius, distFn,
+                                    expanded[lane]);
+                windows[lane] = &*expanded[lane];
+            }
+            DTWStatistics::local().addPass(0, windows[lane]->size());
+        }
+        STRI::getWarpDistsBetween(tsI, tsJ, windows, count, distFn, lanes);
+    }
+    
+    template <typename ValueType,JInt nDimension, typename DistanceFunction>
+    inline ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI,TimeSeries<ValueType,nDimension> const& tsJ,
+                                        JInt searchRadius,DistanceFunction const& distFn, ValueType cutoff)
+    {
+        return getWarpDistBetween(tsI, (PAAPyramid<ValueType,nDimension> const*)NULL, tsJ, (PAAPyramid<ValueType,nDimension> const*)NULL,
+                                  searchRadius, distFn, cutoff);
+    }
+    
     template <typename ValueType,JInt nDimension, typename DistanceFunction>
     inline ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI,TimeSeries<ValueType,nDimension> const& tsJ, DistanceFunction const& distFn)
     {
-        return getWarpInfoBetween(tsI, tsJ, DEFAULT_SEARCH_RADIUS, distFn).getDistance();
+        return getWarpDistBetween(tsI, tsJ, DEFAULT_SEARCH_RADIUS, distFn, numeric_limits<ValueType>::max());
     }
     
     template <typename ValueType,JInt nDimension, typename DistanceFunction>
@@ -65,7 +192,7 @@ namespace FAST {
     inline ValueType getWarpDistBetween(TimeSeries<ValueType,nDimension> const& tsI,TimeSeries<ValueType,nDimension> const& tsJ,
                                         JInt searchRadius,DistanceFunction const& distFn)
     {
-        return getWarpInfoBetween(tsI, tsJ, searchRadius, distFn).getDistance();
+        return getWarpDistBetween(tsI, tsJ, searchRadius, distFn, numeric_limits<ValueType>::max());
     }
     
     
@@ -36,6 +36,18 @@ public:
         return diffSum;
     }
     
+    // Distance between two points given as spans of nDimension values.
+    template <typename ValueType>
+    ValueType calcDistance(const ValueType* v1, const ValueType* v2, JInt nDimension) const
+    {
+        ValueType diffSum = 0;
+        for (JInt i = 0; i<nDimension; ++i)
+        {
+            diffSum += abs(v1[i] - v2[i]);
+        }
+        return diffSum;
+    }
+    
     template <typename ValueType>
     ValueType calcDistance(const std::vector<ValueType>& v1, const std::vector<ValueType>& v2) const
     {
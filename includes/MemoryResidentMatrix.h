@@ -12,6 +12,7 @@
 #include "CostMatrix.h"
 #include "SearchWindow.h"
 #include "FDAssert.h"
+#include "Workspace.h"
 #include <vector>
 #include <limits>
 FD_NS_START
@@ -25,8 +26,12 @@ class MemoryResidentMatrix : public CostMatrix<ValueType>
     vector<JInt> _colOffsets;
     const SearchWindow* _window;
 public:
-    MemoryResidentMatrix(const SearchWindow* searchWindow):_window(searchWindow),_cellValues(searchWindow->size()),_colOffsets(searchWindow->maxI()+1)
+    MemoryResidentMatrix(const SearchWindow* searchWindow):_window(searchWindow),
+        _cellValues(WorkspacePool<ValueType>::local().acquire(searchWindow->size())),
+        _colOffsets(WorkspacePool<JInt>::local().acquire(searchWindow->maxI()+1))
     {
+        _cellValues.resize(searchWindow->size());
+        _colOffsets.resize(searchWindow->maxI()+1);
         JInt currentOffset = 0;
         for (JInt i = searchWindow->minI(); i<=searchWindow->maxI(); ++i) {
             _colOffsets[i] = currentOffset;
@@ -34,6 +39,12 @@ public:
         }
     }
     
+    ~MemoryResidentMatrix()
+    {
+        WorkspacePool<ValueType>::local().release(_cellValues);
+        WorkspacePool<JInt>::local().release(_colOffsets);
+    }
+    
     void put(JInt col, JInt row, ValueType value)
     {
         FDASSERT(row>=_window->minJForI(col) && row <= _window->maxJForI(col), "CostMatrix is filled in a cell (col=%ld, row=%ld) that is not in the search window",col,row);
@@ -51,6 +62,12 @@ public:
         }
     }
     
+    // The cells of column col, from row minJForI(col) of the window upwards.
+    ValueType* column(JInt col)
+    {
+        return _cellValues.data() + _colOffsets[col];
+    }
+    
     JInt size() const
     {
         return _cellValues.size();
@@ -13,37 +13,55 @@
 #include <vector>
 #include "TimeSeries.h"
 #include "FDAssert.h"
+#include "Workspace.h"
 #include <cmath>
+#include <utility>
 FD_NS_START
 template <typename  ValueType,JInt nDimension>
 class PAA : public TimeSeries<ValueType, nDimension>
 {
     vector<JInt> _aggPtSize;
     JInt _originalLength;
+    JBool _fromWorkspace;
+    
+    typedef TimeSeries<ValueType, nDimension> Base;
 public:
     
-    PAA(const TimeSeries<ValueType,nDimension>& ts, JInt shrunkSize):TimeSeries<ValueType, nDimension>(), _originalLength(ts.size()),_aggPtSize(shrunkSize)
+    // A PAA that only lives for one comparison can draw its buffers from the calling thread's workspace
+    //    (fromWorkspace), which then gets them back when it is destroyed.
+    PAA(const TimeSeries<ValueType,nDimension>& ts, JInt shrunkSize, JBool fromWorkspace = false):TimeSeries<ValueType, nDimension>(),
+        _aggPtSize(),_originalLength(ts.size()),_fromWorkspace(fromWorkspace)
     {
         FDASSERT(shrunkSize>0 && shrunkSize <= ts.size(),"ERROR:  The size of an aggregate representation must be greater than zero and \nno larger than the original time series. (shrunkSize=%ld , origSize=%ld).",shrunkSize,ts.size());
-        // Ensures that the data structure storing the time series will not need
-        //    to be expanded more than once.  (not necessary, for optimization)
-        TimeSeries<ValueType,nDimension>::setMaxCapacity(shrunkSize);
-        TimeSeries<ValueType,nDimension>::setLabels(*ts.getLabels());
+        // Ensures that the data structures storing the time series will not need
+        //    to be expanded.  (not necessary, for optimization)
+        if (fromWorkspace) {
+            Base::_values = WorkspacePool<ValueType>::local().acquire(shrunkSize*nDimension);
+            Base::_timeReadings = WorkspacePool<JDouble>::local().acquire(shrunkSize);
+            _aggPtSize = WorkspacePool<JInt>::local().acquire(shrunkSize);
+        }
+        else
+        {
+            Base::_values.reserve(shrunkSize*nDimension);
+            Base::_timeReadings.reserve(shrunkSize);
+            _aggPtSize.reserve(shrunkSize);
+        }
+        Base::copyLabels(ts);
         JDouble reducedPtSize = ts.size()/(JDouble)shrunkSize;
         JInt ptToReadFrom(0);
         JInt ptToReadTo;
         while (ptToReadFrom < ts.size()) {
-            ptToReadTo = (JInt)round(reducedPtSize*(TimeSeries<ValueType,nDimension>::size()+1)) -1;
+            ptToReadTo = (JInt)round(reducedPtSize*(_aggPtSize.size()+1)) -1;
 
             JInt ptsToRead = ptToReadTo - ptToReadFrom + 1;
             JDouble timeSum(0.0);
             ValueType measurementSums[nDimension];
             fill(measurementSums, measurementSums+nDimension, 0);
             for (JInt pt = ptToReadFrom; pt<=ptToReadTo; ++pt) {
-                const MeasurementVector<ValueType, nDimension> *currentPoint = ts.getMeasurementVector(pt);
+                const ValueType *currentPoint = ts.getMeasurements(pt);
                 timeSum += ts.getTimeAtNthPoint(pt);
                 for (JInt dim = 0; dim<ts.numOfDimensions(); ++dim) {
-                    measurementSums[dim] += (*currentPoint)[dim];
+                    measurementSums[dim] += currentPoint[dim];
                 }
             }
             // Determine the average value over the range ptToReadFrom...ptToReadFrom.
@@ -51,10 +69,32 @@ public:
             for (JInt dim = 0; dim<ts.numOfDimensions(); dim++) {
                 measurementSums[dim] = measurementSums[dim] / ptsToRead;
             }
-            _aggPtSize[TimeSeries<ValueType,nDimension>::size()] = ptsToRead;
-            TimeSeries<ValueType,nDimension>::addLast(timeSum,TimeSeriesPoint<ValueType,nDimension>(measurementSums));
+            // Appended directly rather than through addLast(), the averaged times are always stored.
+            _aggPtSize.push_back(ptsToRead);
+            Base::_timeReadings.push_back(timeSum);
+            Base::_values.insert(Base::_values.end(), measurementSums, measurementSums+nDimension);
             ptToReadFrom = ptToReadTo + 1;
         }
+        Base::attachOwnStorage();
+    }
+    
+    PAA(const PAA& paa):TimeSeries<ValueType, nDimension>(paa),_aggPtSize(paa._aggPtSize),_originalLength(paa._originalLength),
+        _fromWorkspace(false)
+    {
+    }
+    
+    PAA(PAA&& paa) noexcept :TimeSeries<ValueType, nDimension>(std::move(paa)),_aggPtSize(std::move(paa._aggPtSize)),
+        _originalLength(paa._originalLength),_fromWorkspace(paa._fromWorkspace)
+    {
+    }
+    
+    ~PAA()
+    {
+        if (_fromWorkspace) {
+            WorkspacePool<ValueType>::local().release(Base::_values);
+            WorkspacePool<JDouble>::local().release(Base::_timeReadings);
+            WorkspacePool<JInt>::local().release(_aggPtSize);
+        }
     }
     
     JInt originalSize() const
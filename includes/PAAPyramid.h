@@ -0,0 +1,64 @@
+//
+//  PAAPyramid.h
+//  FastDTW-x
+//
+
+#ifndef __FastDTW_x__PAAPyramid__
+#define __FastDTW_x__PAAPyramid__
+
+#include "Foundation.h"
+#include <vector>
+#include "TimeSeries.h"
+#include "PAA.h"
+#include "FDAssert.h"
+
+FD_NS_START
+// All the coarser resolutions FastDTW recurses through for one time series: level 1 halves the series, and every
+//    further level halves the one before, down to at most 2 points (what a search radius of 0 recurses to). The
+//    levels are exactly the PAAs FastDTW would build itself, so a pyramid can be built once per series and shared
+//    by every comparison that uses the whole series. Immutable once built.
+template <typename ValueType,JInt nDimension>
+class PAAPyramid
+{
+    vector<PAA<ValueType,nDimension> > _levels;
+    JInt _originalLength;
+public:
+
+    explicit PAAPyramid(const TimeSeries<ValueType,nDimension>& ts):_levels(),_originalLength(ts.size())
+    {
+        // Reserved up front, every level is built from the one before it.
+        JInt numOfLevels = 0;
+        for (JInt size = ts.size(); size > 2; size /= 2) {
+            ++numOfLevels;
+        }
+        _levels.reserve(numOfLevels);
+
+        const TimeSeries<ValueType,nDimension>* previous = &ts;
+        while (previous->size() > 2) {
+            _levels.push_back(PAA<ValueType,nDimension>(*previous, (JInt)(previous->size()/2.0)));
+            previous = &_levels.back();
+        }
+    }
+
+    // Size of the series the pyramid was built from.
+    JInt originalSize() const
+    {
+        return _originalLength;
+    }
+
+    // Number of coarser levels, i.e. the deepest valid argument to getLevel().
+    JInt numOfLevels() const
+    {
+        return _levels.size();
+    }
+
+    // The series shrunk level times (level >= 1).
+    const PAA<ValueType,nDimension>& getLevel(JInt level) const
+    {
+        FDASSERT(level>=1 && level<=numOfLevels(), "ERROR:  level %ld requested from a PAA pyramid of %ld levels.",level,numOfLevels());
+        return _levels[level-1];
+    }
+};
+
+FD_NS_END
+#endif /* defined(__FastDTW_x__PAAPyramid__) */
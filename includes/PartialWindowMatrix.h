@@ -47,7 +47,7 @@ public:
     
     void put(JInt col, JInt row, ValueType value)
     {
-        FDASSERT(row>=_window->minJForI(col)&&row<=_window->maxJForI(col), "CostMatrix is filled in a cell (col=%d, row=%d) that is not in the search window",col, row);
+        FDASSERT(row>=_window->minJForI(col)&&row<=_window->maxJForI(col), "CostMatrix is filled in a cell (col=%ld, row=%ld) that is not in the search window",col, row);
         if (col == _currColIndex) {
             _currCol[row - _minCurrRow] = value;
         }
@@ -57,11 +57,11 @@ public:
         }
         else if(col == _currColIndex + 1)
         {
-            _lastCol = _currCol;
+            // Recycle the storage of the column that falls out of the matrix instead of copying.
+            _lastCol.swap(_currCol);
             _minLastRow = _minCurrRow;
             _currColIndex ++;
-            _currCol.clear();
-            _currCol.resize(_window->maxJForI(col) - _window->minJForI(col) + 1);
+            _currCol.assign(_window->maxJForI(col) - _window->minJForI(col) + 1, 0);
             _minCurrRow = _window->minJForI(col);
             _currCol[row - _minCurrRow] = value;
         }
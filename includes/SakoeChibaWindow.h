@@ -0,0 +1,49 @@
+//
+//  SakoeChibaWindow.h
+//  FastDTW-x
+//
+
+#ifndef __FastDTW_x__SakoeChibaWindow__
+#define __FastDTW_x__SakoeChibaWindow__
+
+#include "Foundation.h"
+#include "SearchWindow.h"
+#include "TimeSeries.h"
+#include <cmath>
+#include "FDMath.h"
+
+FD_NS_START
+// Sakoe-Chiba band: the cells at most bandRadius rows away from the straight line between (0,0) and
+//    (tsI.size()-1,tsJ.size()-1). The line is rasterised as in LinearWindow, so when tsJ is the longer series a
+//    column holds every row the line crosses in it, and the band widens each column by bandRadius rows up and down.
+//    The bounds never decrease from one column to the next, so exact DTW within the band runs on the anti-diagonal
+//    kernels (see STRI::diagonalBounds()).
+class SakoeChibaWindow : public SearchWindow
+{
+public:
+    template <typename ValueType,JInt nDimension>
+    SakoeChibaWindow(const TimeSeries<ValueType,nDimension>& tsI, const TimeSeries<ValueType,nDimension>& tsJ, JInt bandRadius):SearchWindow(tsI.size(),tsJ.size())
+    {
+        if (bandRadius < 0) {
+            bandRadius = 0;
+        }
+        JDouble ijRatio = tsI.size()/(JDouble)tsJ.size();
+        JBool isIlargest = tsI.size() >= tsJ.size();
+        for (JInt i = 0; i<tsI.size(); ++i) {
+            JInt minJ;
+            JInt maxJ;
+            if (isIlargest) {
+                minJ = maxJ = fd_min((JInt)round(i/ijRatio) , tsJ.size() - 1);
+            }
+            else
+            {
+                minJ = (JInt)round(i/ijRatio);
+                maxJ = (JInt)round((i+1)/ijRatio) - 1;
+            }
+            markVisited(i, fd_max(minJ - bandRadius, this->minJ()), fd_min(maxJ + bandRadius, this->maxJ()));
+        }
+    }
+};
+
+FD_NS_END
+#endif /* defined(__FastDTW_x__SakoeChibaWindow__) */
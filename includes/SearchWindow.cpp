@@ -9,6 +9,7 @@
 #include "SearchWindow.h"
 #include "FDAssert.h"
 #include "FDMath.h"
+#include "Workspace.h"
 
 FD_NS_START
 
@@ -45,15 +46,17 @@ ColMajorCell SearchWindowIterator::next()
     return cell;
 }
 
-SearchWindow::SearchWindow(JInt tsIsize, JInt tsJsize):_minValues(tsIsize, -1),_maxValues(tsIsize),_maxJ(tsJsize -1),_size(0),_modCount(0)
+SearchWindow::SearchWindow(JInt tsIsize, JInt tsJsize):_minValues(WorkspacePool<JInt>::local().acquire(tsIsize)),
+    _maxValues(WorkspacePool<JInt>::local().acquire(tsIsize)),_maxJ(tsJsize -1),_size(0),_modCount(0)
 {
-//    fill(_minValues.begin(), _minValues.end(), -1);
-//    fill(_maxValues.begin(), _maxValues.end(), 0);
+    _minValues.assign(tsIsize, -1);
+    _maxValues.assign(tsIsize, 0);
 }
 
 SearchWindow::~SearchWindow()
 {
-    
+    WorkspacePool<JInt>::local().release(_minValues);
+    WorkspacePool<JInt>::local().release(_maxValues);
 }
 
 JBool SearchWindow::isInWindow(JInt i, JInt j) const
@@ -109,118 +112,80 @@ SearchWindowIterator SearchWindow::iterator() const
 void SearchWindow::expandSearchWindow(JInt radius)
 {
     if (radius >0) {
-        // Add all cells in the current Window to an array, iterating through the window and expanding the window
-        //    at the same time is not possible because the window can't be changed during iteration through the cells.
-        vector<ColMajorCell> windowCells;
-        windowCells.reserve(size());
-        SearchWindowIterator it = iterator();
-        for (; it.hasNext();) {
-            windowCells.push_back(it.next());
-        }
-        for (JInt cell = 0; cell<windowCells.size(); ++cell) {
-            ColMajorCell currentCell = windowCells[cell];
-            if (currentCell.getCol()!=minI() && currentCell.getRow()!=maxJ()) {// move to upper left if possible
-                // Either extend full search radius or some fraction until edges of matrix are met.
-                JInt targetCol = currentCell.getCol() - radius;
-                JInt targetRow = currentCell.getRow() + radius;
-                if (targetCol>=minI()&&targetRow<=maxJ()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = fd_max(minI() - targetCol, targetRow - maxJ());
-                    markVisited(targetCol+cellsPastEdge, targetRow - cellsPastEdge);
-                }
-            }
-            
-            if (currentCell.getRow() != maxJ()) {// move up if possible
-                JInt targetCol = currentCell.getCol();
-                JInt targetRow = currentCell.getRow()+radius;
-                if (targetRow <= maxJ()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = targetRow - maxJ();
-                    markVisited(targetCol, targetRow - cellsPastEdge);
-                }
-            }
-            
-            if (currentCell.getCol()!=maxI()&&currentCell.getRow()!=maxJ()) {// move to upper-right if possible
-                JInt targetCol = currentCell.getCol() + radius;
-                JInt targetRow = currentCell.getRow() + radius;
-                if (targetCol<=maxI()&&targetRow<=maxJ()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = fd_max(targetCol - maxI() , targetRow - maxJ());
-                    markVisited(targetCol-cellsPastEdge, targetRow-cellsPastEdge);
-                }
-            }
-            if (currentCell.getCol()!=minI()) {// move left if possible
-                JInt targetCol = currentCell.getCol() - radius;
-                JInt targetRow = currentCell.getRow();
-                if (targetCol >= minI()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = minI() - targetCol;
-                    markVisited(targetCol+cellsPastEdge, targetRow);
-                }
+        // Every cell of the window moves radius cells in each of the 8 directions, or fewer where it reaches an edge
+        //    of the matrix, and each column is widened to cover the cells that land in it. All cells of a column that
+        //    move the full distance land in one interval of rows of one column. The ones that stop at the top (bottom)
+        //    edge early land on the top (bottom) row of a run of columns, which is collected in a difference array.
+        //    Each column is an interval of rows, so this is done column by column rather than cell by cell.
+        WorkspaceBuffer<JInt> oldMinBuffer(_minValues.size());
+        WorkspaceBuffer<JInt> oldMaxBuffer(_maxValues.size());
+        copy(_minValues.begin(), _minValues.end(), oldMinBuffer->begin());
+        copy(_maxValues.begin(), _maxValues.end(), oldMaxBuffer->begin());
+        const vector<JInt>& oldMin = *oldMinBuffer;
+        const vector<JInt>& oldMax = *oldMaxBuffer;
+        WorkspaceBuffer<JInt> topRunsBuffer(oldMin.size()+1, 0);
+        WorkspaceBuffer<JInt> bottomRunsBuffer(oldMin.size()+1, 0);
+        vector<JInt>& topRuns = *topRunsBuffer;
+        vector<JInt>& bottomRuns = *bottomRunsBuffer;
+        for (JInt i = minI(); i<=maxI(); ++i) {
+            // The cell iterator this replaces starts at (minI(), minJ()) rather than at the first cell of column
+            //    minI(), so the cells below the window in that column are expanded as well.
+            JInt lo = i == minI() ? minJ() : oldMin[i];
+            JInt hi = oldMax[i];
+            if (oldMin[i] == -1) {
+                continue;
             }
+            // move up and down
+            markVisited(i, fd_max(lo - radius, minJ()), fd_min(hi + radius, maxJ()));
             
-            if (currentCell.getCol()!= maxI()) {// move right if possible
-                JInt targetCol = currentCell.getCol() + radius;
-                JInt targetRow = currentCell.getRow();
-                if (targetCol<=maxI()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = targetCol - maxI();
-                    markVisited(targetCol - cellsPastEdge, targetRow);
-                }
-            }
+            // move left and right
+            markVisited(i - fd_min(radius, i - minI()), lo, hi);
+            markVisited(i + fd_min(radius, maxI() - i), lo, hi);
             
-            if (currentCell.getCol()!=minI() && currentCell.getRow()!=minJ()) { // move to lower-left if possible
-                JInt targetCol = currentCell.getCol() - radius;
-                JInt targetRow = currentCell.getRow() - radius;
-                if (targetCol>=minI() && targetRow>=minJ()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = fd_max(minI() - targetCol, minJ() - targetRow);
-                    markVisited(targetCol+cellsPastEdge,targetRow+cellsPastEdge);
+            // move diagonally, to the left (dx = -1) and to the right (dx = 1)
+            for (JInt dx = -1; dx<=1; dx += 2) {
+                JInt steps = fd_min(radius, dx < 0 ? i - minI() : maxI() - i);
+                JInt targetCol = i + dx*steps;
+                
+                // Upwards: rows up to maxJ()-steps move all steps, the ones above stop on the top row after maxJ()-row
+                //    steps.
+                JInt lastFull = fd_min(hi, maxJ() - steps);
+                if (lo<=lastFull) {
+                    markVisited(targetCol, lo + steps, lastFull + steps);
+                }
+                JInt firstShort = fd_max(lo, maxJ() - steps + 1);
+                if (firstShort<=hi) {
+                    JInt colA = i + dx*(maxJ() - hi);
+                    JInt colB = i + dx*(maxJ() - firstShort);
+                    ++topRuns[fd_min(colA, colB)];
+                    --topRuns[fd_max(colA, colB) + 1];
+                }
+                
+                // Downwards: rows from minJ()+steps move all steps, the ones below stop on the bottom row after
+                //    row-minJ() steps.
+                JInt firstFull = fd_max(lo, minJ() + steps);
+                if (firstFull<=hi) {
+                    markVisited(targetCol, firstFull - steps, hi - steps);
+                }
+                JInt lastShort = fd_min(hi, minJ() + steps - 1);
+                if (lo<=lastShort) {
+                    JInt colA = i + dx*(lo - minJ());
+                    JInt colB = i + dx*(lastShort - minJ());
+                    ++bottomRuns[fd_min(colA, colB)];
+                    --bottomRuns[fd_max(colA, colB) + 1];
                 }
             }
-            
-            if (currentCell.getRow()!=minJ()) {// move down if possible
-                JInt targetCol = currentCell.getCol();
-                JInt targetRow = currentCell.getRow() - radius;
-                if (targetRow>=minJ()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = minJ() - targetRow;
-                    markVisited(targetCol, targetRow+cellsPastEdge);
-                }
+        }
+        JInt onTop = 0;
+        JInt onBottom = 0;
+        for (JInt i = minI(); i<=maxI(); ++i) {
+            onTop += topRuns[i];
+            onBottom += bottomRuns[i];
+            if (onTop > 0) {
+                markVisited(i, maxJ());
             }
-            
-            if (currentCell.getCol()!=maxI() && currentCell.getRow() != minJ()) {// move to lower-right if possible
-                JInt targetCol = currentCell.getCol() + radius;
-                JInt targetRow = currentCell.getRow() - radius;
-                if (targetCol<=maxI() && targetRow>=minJ()) {
-                    markVisited(targetCol, targetRow);
-                }
-                else
-                {
-                    JInt cellsPastEdge = fd_max(targetCol-maxI(), minJ() - targetRow);
-                    markVisited(targetCol-cellsPastEdge, targetRow+cellsPastEdge);
-                }
+            if (onBottom > 0) {
+                markVisited(i, minJ());
             }
         }
     }
@@ -257,4 +222,25 @@ void SearchWindow::markVisited(JInt col, JInt row)
     }
 }
 
-FD_NS_END
\ No newline at end of file
+void SearchWindow::markVisited(JInt col, JInt minRow, JInt maxRow)
+{
+    if (_minValues[col] == -1) {
+        _minValues[col] = minRow;
+        _maxValues[col] = maxRow;
+        _size += maxRow - minRow + 1;
+        _modCount++;
+        return;
+    }
+    if (_minValues[col]>minRow) {
+        _size+=_minValues[col] - minRow;
+        _minValues[col] = minRow;
+        _modCount++;
+    }
+    if (_maxValues[col]<maxRow) {
+        _size+=maxRow - _maxValues[col];
+        _maxValues[col] = maxRow;
+        _modCount++;
+    }
+}
+
+FD_NS_END
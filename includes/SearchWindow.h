@@ -75,6 +75,9 @@ protected:
     
     void markVisited(JInt col, JInt row);
     
+    // Marks the rows minRow...maxRow of column col.
+    void markVisited(JInt col, JInt minRow, JInt maxRow);
+    
 };
 
 FD_NS_END
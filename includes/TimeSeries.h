@@ -31,46 +31,177 @@ private:
    
    
 protected:
+    // Empty unless custom labels were set, see getLabels().
     vector<string> _labels;
+    // Empty while the time axis is implicit, i.e. the time of every point equals its index.
     vector<JDouble> _timeReadings;
-    vector<TimeSeriesPoint<ValueType,nDimension> > _tsArray;
+    // All measurements in one contiguous buffer, point after point (_stride values per point).
+    vector<ValueType> _values;
+    
+    // Where the readings are actually read from: this series' own storage, or the storage of the series it is a
+    //    prefix view of. _times is NULL while the time axis is implicit.
+    const ValueType* _data;
+    const JDouble* _times;
+    JInt _size;
+    JInt _stride;
+    JBool _isView;
+    
+    void attachOwnStorage()
+    {
+        _data = _values.data();
+        _times = _timeReadings.empty() ? NULL : _timeReadings.data();
+        _size = _stride > 0 ? _values.size() / _stride : 0;
+    }
+    
+    void attachTo(const TimeSeries& timeseries, JInt size)
+    {
+        _data = timeseries._data;
+        _times = timeseries._times;
+        _size = size;
+    }
+    
+    // Switches from the implicit time axis to explicitly stored time readings.
+    void materializeTimeReadings()
+    {
+        if (_timeReadings.empty()) {
+            _timeReadings.reserve(_values.capacity() / (_stride > 0 ? _stride : 1));
+            for (JInt i = 0; i<_size; ++i) {
+                _timeReadings.push_back(i);
+            }
+        }
+    }
     
     void setMaxCapacity(JInt capacity)
     {
-        _timeReadings.reserve(capacity);
-        _tsArray.reserve(capacity);
+        FDASSERT0(!_isView, "ERROR:  a prefix view of a time series cannot be modified.");
+        if (!_timeReadings.empty()) {
+            _timeReadings.reserve(capacity);
+        }
+        _values.reserve(capacity * (_stride > 0 ? _stride : 1));
+        attachOwnStorage();
+    }
+    
+    void copyLabels(const TimeSeries& timeseries)
+    {
+        _labels = timeseries._labels;
     }
-public:
-
     
-    TimeSeries():_labels(),_timeReadings(),_tsArray()
+    static const vector<string>& defaultLabels()
     {
-        _labels.push_back(string("time"));
+        static const vector<string> labels = makeDefaultLabels();
+        return labels;
+    }
+    
+    static vector<string> makeDefaultLabels()
+    {
+        vector<string> labels;
+        labels.push_back(string("time"));
         stringstream ss;
-
+        
         for (JInt i = 0; i<nDimension; ++i) {
-			ss.clear();
+            ss.str("");
             ss << i;
-			_labels.push_back(ss.str());
+            labels.push_back(ss.str());
         }
+        return labels;
     }
+public:
+
     
-    TimeSeries(TimeSeries& timeseries):_labels(timeseries._labels),_timeReadings(timeseries._timeReadings),_tsArray(timeseries._tsArray)
+    TimeSeries():_labels(),_timeReadings(),_values(),_stride(nDimension),_isView(false)
+    {
+        attachOwnStorage();
+    }
+    
+    // Series owning the given measurements (point after point) on an implicit time axis.
+    explicit TimeSeries(vector<ValueType> values):_labels(),_timeReadings(),_values(std::move(values)),_stride(nDimension),_isView(false)
+    {
+        FDASSERT0(nDimension > 0, "ERROR:  the dimension of a dynamic time series cannot be derived from its values.");
+        attachOwnStorage();
+    }
+    
+    TimeSeries(const TimeSeries& timeseries):_labels(timeseries._labels),_stride(timeseries._stride),_isView(timeseries._isView)
+    {
+        if (_isView) {
+            attachTo(timeseries, timeseries._size);
+        }
+        else
+        {
+            _timeReadings = timeseries._timeReadings;
+            _values = timeseries._values;
+            attachOwnStorage();
+        }
+    }
+    
+    TimeSeries(TimeSeries&& timeseries) noexcept :_labels(std::move(timeseries._labels)),_stride(timeseries._stride),_isView(timeseries._isView)
+    {
+        if (_isView) {
+            attachTo(timeseries, timeseries._size);
+        }
+        else
+        {
+            _timeReadings = std::move(timeseries._timeReadings);
+            _values = std::move(timeseries._values);
+            attachOwnStorage();
+            timeseries.attachOwnStorage();
+        }
+    }
+    
+    // Read-only view of the first prefixLength points of timeseries, sharing its storage instead of copying it.
+    //    timeseries must outlive the view and must not be modified while the view is in use.
+    TimeSeries(const TimeSeries& timeseries, JInt prefixLength):_labels(timeseries._labels),_timeReadings(),_values(),
+        _stride(timeseries._stride),_isView(true)
+    {
+        FDASSERT(prefixLength>=0 && prefixLength<=timeseries.size(), "ERROR:  prefix of %ld points requested from a time series of %ld points.",prefixLength,timeseries.size());
+        attachTo(timeseries, prefixLength);
+    }
+    
+    // Read-only view of size points stored elsewhere (point after point, on an implicit time axis), e.g. in a memory
+    //    mapped file. The storage must outlive the view.
+    TimeSeries(const ValueType* values, JInt size):_labels(),_timeReadings(),_values(),
+        _data(values),_times(NULL),_size(size),_stride(nDimension),_isView(true)
+    {
+        FDASSERT0(nDimension > 0, "ERROR:  the dimension of a dynamic time series cannot be derived from its values.");
+    }
+    
+    TimeSeries& operator=(const TimeSeries& timeseries)
+    {
+        if (this != &timeseries) {
+            _labels = timeseries._labels;
+            _stride = timeseries._stride;
+            _isView = timeseries._isView;
+            if (_isView) {
+                _timeReadings.clear();
+                _values.clear();
+                attachTo(timeseries, timeseries._size);
+            }
+            else
+            {
+                _timeReadings = timeseries._timeReadings;
+                _values = timeseries._values;
+                attachOwnStorage();
+            }
+        }
+        return *this;
+    }
+    
+    virtual ~TimeSeries()
     {
-        
     }
         
     //ignored file io interfaces
     
     void clear()
     {
+        FDASSERT0(!_isView, "ERROR:  a prefix view of a time series cannot be modified.");
         _timeReadings.clear();
-        _tsArray.clear();
+        _values.clear();
+        attachOwnStorage();
     }
     
     JInt size() const
     {
-        return _timeReadings.size();
+        return _size;
     }
     
     JInt numOfPts() const
@@ -80,17 +211,17 @@ public:
     
     JInt numOfDimensions() const
     {
-        return _labels.size() - 1;//potential bug when use default constructor
+        return nDimension > 0 ? nDimension : _stride;
     }
     
     JDouble getTimeAtNthPoint(JInt n) const
     {
-        return _timeReadings[n];
+        return _times ? _times[n] : n;
     }
     
-    string& getLabel(JInt n) const
+    const string& getLabel(JInt n) const
     {
-        return _labels[n];
+        return (*getLabels())[n];
     }
 //    
 //    JInt getLabelsArr(string* strArr,JInt maxNum)
@@ -103,69 +234,108 @@ public:
     void setLabels(const vector<string>& lbs)
     {
         _labels = lbs;
+        if (nDimension == 0 && _size == 0) {
+            _stride = _labels.size() - 1;
+        }
     }
     
     void setLabels(const string* strArr,JInt num)
     {
-        _labels.clear();
-        _labels.reserve(num);
-        copy(strArr, strArr+num, _labels.begin());
+        setLabels(vector<string>(strArr, strArr+num));
     }
     
+    // Custom labels if any were set, otherwise "time" followed by the dimension indexes. The defaults are shared by
+    //    all series instead of being built for each of them.
     const vector<string>* getLabels() const
     {
-        return &_labels;
+        return _labels.empty() ? &defaultLabels() : &_labels;
     }
     
     ValueType getMeasurement(JInt pointIndex, string& valueLabel) const
     {
-        JInt idx = find(_labels.begin(), _labels.end(), valueLabel) - _labels.begin();
+        const vector<string>& labels = *getLabels();
+        JInt idx = find(labels.begin(), labels.end(), valueLabel) - labels.begin();
         FDASSERT(idx>0, "ERROR:  the label %s was not one of labels",valueLabel.data());
-        return _tsArray[pointIndex].get(idx - 1);
+        return getMeasurement(pointIndex, idx - 1);
     }
     
     ValueType getMeasurement(JInt pointIndex, JInt valueIndex) const
     {
-        return _tsArray[pointIndex].get(valueIndex);
+        return _data[pointIndex * numOfDimensions() + valueIndex];
+    }
+    
+    // The numOfDimensions() measurements of a point, for the span based calcDistance of the distance functions.
+    const ValueType* getMeasurements(JInt pointIndex) const
+    {
+        return _data + pointIndex * numOfDimensions();
+    }
+    
+    // All measurements of the series, point after point.
+    const ValueType* data() const
+    {
+        return _data;
     }
     
-    const MeasurementVector<ValueType, nDimension>* getMeasurementVector(JInt pointIndex) const
+    MeasurementVector<ValueType, nDimension> getMeasurementVector(JInt pointIndex) const
     {
-        return _tsArray[pointIndex].toArray();
+        MeasurementVector<ValueType, nDimension> measurements(getMeasurements(pointIndex));
+        if (nDimension == 0) {
+            measurements.setDynamicMeasurements(getMeasurements(pointIndex), _stride);
+        }
+        return measurements;
     }
     
     void setMeasurement(JInt pointIndex,JInt valueIndex,ValueType value)
     {
-        _tsArray[pointIndex].set(valueIndex,value);
+        FDASSERT0(!_isView, "ERROR:  a prefix view of a time series cannot be modified.");
+        _values[pointIndex * numOfDimensions() + valueIndex] = value;
     }
     
     void addFirst(JDouble time, TimeSeriesPoint<ValueType,nDimension> const& values)
     {
-        FDASSERT(values.size()+1 == _labels.size(), "ERROR:  The TimeSeriesPoint contains the wrong number of values. expected:%ld,found:%ld",_labels.size()-1,values.size());
-        FDASSERT0(time<_timeReadings[0], "ERROR:  The point being inserted into the beginning of the time series does not have the correct time sequence.");
+        FDASSERT0(!_isView, "ERROR:  a prefix view of a time series cannot be modified.");
+        if (nDimension == 0 && _size == 0 && _labels.empty()) {
+            _stride = values.size();
+        }
+        FDASSERT(values.size() == numOfDimensions(), "ERROR:  The TimeSeriesPoint contains the wrong number of values. expected:%ld,found:%ld",numOfDimensions(),values.size());
+        FDASSERT0(_size==0 || time<getTimeAtNthPoint(0), "ERROR:  The point being inserted into the beginning of the time series does not have the correct time sequence.");
+        materializeTimeReadings();
         _timeReadings.insert(_timeReadings.begin(), time);
-        _tsArray.insert(_tsArray.begin(),values);
+        for (JInt dim = values.size() - 1; dim>=0; --dim) {
+            _values.insert(_values.begin(), values.get(dim));
+        }
+        attachOwnStorage();
     }
     
     void addLast(JDouble time, TimeSeriesPoint<ValueType,nDimension> const& values)
     {
-        FDASSERT(values.size()+1 == _labels.size(), "ERROR:  The TimeSeriesPoint contains the wrong number of values. expected:%ld,found:%ld",_labels.size()-1,values.size());
-        FDASSERT0(_timeReadings.size()==0 || time>_timeReadings[_timeReadings.size() - 1], "ERROR:  The point being inserted into the beginning of the time series does not have the correct time sequence.");
-        _timeReadings.push_back(time);
-        _tsArray.push_back(values);
+        FDASSERT0(!_isView, "ERROR:  a prefix view of a time series cannot be modified.");
+        if (nDimension == 0 && _size == 0 && _labels.empty()) {
+            _stride = values.size();
+        }
+        FDASSERT(values.size() == numOfDimensions(), "ERROR:  The TimeSeriesPoint contains the wrong number of values. expected:%ld,found:%ld",numOfDimensions(),values.size());
+        FDASSERT0(_size==0 || time>getTimeAtNthPoint(_size - 1), "ERROR:  The point being inserted into the beginning of the time series does not have the correct time sequence.");
+        if (!_timeReadings.empty() || time != _size) {
+            materializeTimeReadings();
+            _timeReadings.push_back(time);
+        }
+        for (JInt dim = 0; dim<values.size(); ++dim) {
+            _values.push_back(values.get(dim));
+        }
+        attachOwnStorage();
     }
     
     virtual void print(ostream& stream) const
     {
-        stream<<"time readings ["<<_timeReadings.size()<<"]:";
-        for (JInt i = 0; i<_timeReadings.size(); ++i) {
-            stream<<_timeReadings[i] << ",";
+        stream<<"time readings ["<<_size<<"]:";
+        for (JInt i = 0; i<_size; ++i) {
+            stream<<getTimeAtNthPoint(i) << ",";
         }
         stream<<"\n";
-        stream<<"time series ["<<_tsArray.size()<<"]:";
-        for(JInt i = 0;i<_tsArray.size();++i)
+        stream<<"time series ["<<_size<<"]:";
+        for(JInt i = 0;i<_size;++i)
         {
-            _tsArray[i].print(stream);
+            getMeasurementVector(i).print(stream);
             stream << ",";
         }
         stream<<"\n";
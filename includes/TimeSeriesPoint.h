@@ -16,20 +16,21 @@
 FD_NS_START
 using namespace std;
 
-//Fixed dimension TimeSeriesPoint template
+//Fixed dimension TimeSeriesPoint template, the values are stored inline.
 template <typename ValueType, JInt nDimension>
 class MeasurementVector
 {
-    vector<ValueType> value;
+    ValueType value[nDimension];
     
 public:
-    MeasurementVector():value(nDimension)
+    MeasurementVector()
     {
+        fill(value, value+nDimension, 0);
     }
     
-    MeasurementVector(const ValueType* meas):value(nDimension)
+    MeasurementVector(const ValueType* meas)
     {
-        copy(meas, meas+nDimension, value.begin());
+        copy(meas, meas+nDimension, value);
     }
     
     void setDynamicMeasurements(const ValueType* meas, JInt nDim)
@@ -39,7 +40,12 @@ public:
     
     JInt size() const
     {
-        return value.size();
+        return nDimension;
+    }
+    
+    const ValueType* data() const
+    {
+        return value;
     }
     
     ValueType operator[](JInt index) const
@@ -54,18 +60,18 @@ public:
     
     bool operator==(const MeasurementVector<ValueType,nDimension>& mv) const
     {
-        return  value == mv.value;
+        return  equal(value, value+nDimension, mv.value);
     }
     
     bool operator<(const MeasurementVector<ValueType, nDimension>& mv) const
     {
-        return value < mv.value;
+        return lexicographical_compare(value, value+nDimension, mv.value, mv.value+nDimension);
     }
     
     void print(ostream& stream) const
     {
         stream<<"p(";
-        for (JInt i = 0; i<value.size(); ++i) {
+        for (JInt i = 0; i<nDimension; ++i) {
             stream << value[i] << ",";
         }
         stream <<")";
@@ -97,6 +103,11 @@ public:
         return 1;
     }
     
+    const ValueType* data() const
+    {
+        return &value;
+    }
+    
     ValueType operator[](JInt index) const
     {
         return value;
@@ -153,6 +164,11 @@ public:
         return value.size();
     }
     
+    const ValueType* data() const
+    {
+        return value.data();
+    }
+    
     ValueType operator[](JInt index) const
     {
         return value[index];
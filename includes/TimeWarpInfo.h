@@ -11,6 +11,7 @@
 
 #include "Foundation.h"
 #include "WarpPath.h"
+#include <utility>
 FD_NS_START
 template <typename ValueType>
 class TimeWarpInfo
@@ -19,7 +20,7 @@ class TimeWarpInfo
     WarpPath _path;
     
 public:
-    TimeWarpInfo(ValueType dist, const WarpPath& wp):_distance(dist), _path(wp)
+    TimeWarpInfo(ValueType dist, WarpPath wp):_distance(dist), _path(std::move(wp))
     {
     }
     
@@ -9,13 +9,46 @@
 #include "WarpPath.h"
 #include <algorithm>
 #include "FDAssert.h"
+#include "Workspace.h"
 
 FD_NS_START
 
-WarpPath::WarpPath(JInt initialCapacity) : _tsIindexes(),_tsJindexes()
+WarpPath::WarpPath(JInt initialCapacity) : _tsIindexes(WorkspacePool<Index>::local().acquire(initialCapacity)),
+    _tsJindexes(WorkspacePool<Index>::local().acquire(initialCapacity))
 {
-    _tsIindexes.reserve(initialCapacity);
-    _tsJindexes.reserve(initialCapacity);
+}
+
+WarpPath::WarpPath(const WarpPath& path) : _tsIindexes(WorkspacePool<Index>::local().acquire(path.size())),
+    _tsJindexes(WorkspacePool<Index>::local().acquire(path.size()))
+{
+    _tsIindexes.assign(path._tsIindexes.begin(), path._tsIindexes.end());
+    _tsJindexes.assign(path._tsJindexes.begin(), path._tsJindexes.end());
+}
+
+WarpPath::WarpPath(WarpPath&& path) noexcept : _tsIindexes(std::move(path._tsIindexes)),_tsJindexes(std::move(path._tsJindexes))
+{
+}
+
+WarpPath& WarpPath::operator=(const WarpPath& path)
+{
+    if (this != &path) {
+        _tsIindexes = path._tsIindexes;
+        _tsJindexes = path._tsJindexes;
+    }
+    return *this;
+}
+
+WarpPath& WarpPath::operator=(WarpPath&& path) noexcept
+{
+    _tsIindexes.swap(path._tsIindexes);
+    _tsJindexes.swap(path._tsJindexes);
+    return *this;
+}
+
+WarpPath::~WarpPath()
+{
+    WorkspacePool<Index>::local().release(_tsIindexes);
+    WorkspacePool<Index>::local().release(_tsJindexes);
 }
 
 
@@ -46,20 +79,28 @@ JInt WarpPath::maxJ() const
 
 void WarpPath::addFirst(JInt i, JInt j)
 {
-    _tsIindexes.insert(_tsIindexes.begin(), i);
-    _tsJindexes.insert(_tsJindexes.begin(), j);
+    FDASSERT0(i>=0 && j>=0 && i<=UINT32_MAX && j<=UINT32_MAX, "ERROR:  warp path index out of range.");
+    _tsIindexes.insert(_tsIindexes.begin(), (Index)i);
+    _tsJindexes.insert(_tsJindexes.begin(), (Index)j);
 }
 
 void WarpPath::addLast(JInt i, JInt j)
 {
-    _tsIindexes.push_back(i);
-    _tsJindexes.push_back(j);
+    FDASSERT0(i>=0 && j>=0 && i<=UINT32_MAX && j<=UINT32_MAX, "ERROR:  warp path index out of range.");
+    _tsIindexes.push_back((Index)i);
+    _tsJindexes.push_back((Index)j);
+}
+
+void WarpPath::reverse()
+{
+    std::reverse(_tsIindexes.begin(), _tsIindexes.end());
+    std::reverse(_tsJindexes.begin(), _tsJindexes.end());
 }
 
 void WarpPath::getMatchingIndexesForI(JInt i,vector<JInt>& outVec) const
 {
-    //find first time i appears
-    vector<JInt>::const_iterator it = find(_tsIindexes.begin(), _tsIindexes.end(), i);
+    //find first time i appears, the indexes are sorted.
+    vector<Index>::const_iterator it = lower_bound(_tsIindexes.begin(), _tsIindexes.end(), (Index)i);
     //find continuous indices of i.
     while (it != _tsIindexes.end() && *it == i)
     {
@@ -70,7 +111,7 @@ void WarpPath::getMatchingIndexesForI(JInt i,vector<JInt>& outVec) const
 
 void WarpPath::getMatchingIndexesForJ(JInt j,vector<JInt>& outVec) const
 {
-    vector<JInt>::const_iterator it = find(_tsJindexes.begin(), _tsJindexes.end(), j);
+    vector<Index>::const_iterator it = lower_bound(_tsJindexes.begin(), _tsJindexes.end(), (Index)j);
     while (it!=_tsJindexes.end() && *it == j) {
         outVec.push_back(_tsIindexes[it-_tsJindexes.begin()]);
         ++it;
@@ -85,9 +126,7 @@ void WarpPath::invertedCopy(WarpPath& path) const
 
 void WarpPath::invert()
 {
-    vector<JInt> tmp = _tsIindexes;
-    _tsIindexes = _tsJindexes;
-    _tsJindexes = tmp;
+    _tsIindexes.swap(_tsJindexes);
 }
 
 ColMajorCell WarpPath::get(JInt index) const
@@ -11,19 +11,34 @@
 
 #include "Foundation.h"
 #include <vector>
+#include <cstdint>
 #include "ColMajorCell.h"
 #include <iostream>
 
 FD_NS_START
 using namespace std;
+// Warp paths run from (0,0) to (maxI,maxJ) and never step back in either index, so both index arrays are sorted.
+//    Indices are stored as 32 bit values.
 class WarpPath
 {
-    vector<JInt> _tsIindexes;
-    vector<JInt> _tsJindexes;
+    typedef uint32_t Index;
+    vector<Index> _tsIindexes;
+    vector<Index> _tsJindexes;
     
 public:
+    // The index arrays are drawn from the calling thread's workspace and given back by the destructor.
     WarpPath(JInt initialCapacity);
     
+    WarpPath(const WarpPath& path);
+    
+    WarpPath(WarpPath&& path) noexcept;
+    
+    WarpPath& operator=(const WarpPath& path);
+    
+    WarpPath& operator=(WarpPath&& path) noexcept;
+    
+    ~WarpPath();
+    
     JInt size() const;
     
     JInt minI() const;
@@ -38,6 +53,9 @@ public:
     
     void addLast(JInt i, JInt j);
     
+    // Reverses the order of the cells, so that a path can be built from its end with addLast() in linear time.
+    void reverse();
+    
     void getMatchingIndexesForI(JInt i,vector<JInt>& outVec) const;
     
     void getMatchingIndexesForJ(JInt j,vector<JInt>& outVec) const;
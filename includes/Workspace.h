@@ -0,0 +1,106 @@
+//
+//  Workspace.h
+//  FastDTW-x
+//
+
+#ifndef __FastDTW_x__Workspace__
+#define __FastDTW_x__Workspace__
+
+#include "Foundation.h"
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+FD_NS_START
+using namespace std;
+
+// Number of times a workspace buffer had to be allocated or grown, summed over all threads. Once every thread has
+//    done its largest comparison it stops increasing, i.e. further comparisons run without heap allocations.
+inline atomic<JLong>& workspaceAllocationCounter()
+{
+    static atomic<JLong> counter(0);
+    return counter;
+}
+
+inline JLong workspaceAllocations()
+{
+    return workspaceAllocationCounter().load();
+}
+
+// Per thread free list of vectors of T, for the temporaries of a comparison (search windows, cost matrices, warp
+//    paths, ...). Buffers keep their capacity while they are in the pool, so after the first few comparisons a thread
+//    finds every buffer it needs already large enough.
+template <typename T>
+class WorkspacePool
+{
+    vector<vector<T> > _free;
+public:
+    static WorkspacePool& local()
+    {
+        static thread_local WorkspacePool pool;
+        return pool;
+    }
+
+    // An empty vector with room for at least capacity elements.
+    vector<T> acquire(size_t capacity)
+    {
+        vector<T> buffer;
+        if (!_free.empty()) {
+            buffer.swap(_free.back());
+            _free.pop_back();
+        }
+        if (buffer.capacity() < capacity) {
+            ++workspaceAllocationCounter();
+            buffer.reserve(capacity);
+        }
+        return buffer;
+    }
+
+    // Takes buffer's storage back, leaving buffer empty.
+    void release(vector<T>& buffer)
+    {
+        if (buffer.capacity() == 0) {
+            return;
+        }
+        if (_free.size() == _free.capacity()) {
+            ++workspaceAllocationCounter();
+        }
+        buffer.clear();
+        _free.push_back(vector<T>());
+        _free.back().swap(buffer);
+    }
+};
+
+// A vector of size elements (set to value) drawn from the calling thread's pool and given back when it goes out of
+//    scope.
+template <typename T>
+class WorkspaceBuffer
+{
+    vector<T> _buffer;
+
+    WorkspaceBuffer(const WorkspaceBuffer&);
+    WorkspaceBuffer& operator=(const WorkspaceBuffer&);
+public:
+    WorkspaceBuffer(size_t size, const T& value = T()):_buffer(WorkspacePool<T>::local().acquire(size))
+    {
+        _buffer.assign(size, value);
+    }
+
+    ~WorkspaceBuffer()
+    {
+        WorkspacePool<T>::local().release(_buffer);
+    }
+
+    vector<T>& operator*()
+    {
+        return _buffer;
+    }
+
+    vector<T>* operator->()
+    {
+        return &_buffer;
+    }
+};
+
+FD_NS_END
+#endif /* defined(__FastDTW_x__Workspace__) */
@@ -0,0 +1,36 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#include "nn_functions.h"
+
+// Converts a .job text file into the memory mappable binary format read by
+// load_TSfile (see ts_binary.h).
+int main(int argc, char** argv) {
+    bool as_float = false;
+    std::string in, out;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--float") == 0) {
+            as_float = true;
+        } else if (in.empty()) {
+            in = argv[i];
+        } else if (out.empty()) {
+            out = argv[i];
+        } else {
+            in.clear();
+            break;
+        }
+    }
+    if (in.empty() || out.empty()) {
+        cerr << "Usage: " << argv[0] << " [--float] input.job output.bin" << endl;
+        cerr << "  --float  store the values as float32 instead of float64" << endl;
+        return 1;
+    }
+
+    std::vector<taggedTS> dataset = load_TSfile(in, 0);
+    if (!write_TSbinary(dataset, out, as_float)) {
+        cerr << "Could not write \"" << out << "\"." << endl;
+        return 1;
+    }
+    return 0;
+}
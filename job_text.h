@@ -0,0 +1,147 @@
+#ifndef JOB_TEXT_H
+#define JOB_TEXT_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#include "tagged_ts.h"
+#include "mapped_file.h"
+
+// Parser for the .job text format: three lines per series, holding the tag
+// and UID, the return times, and the absolute times, each whitespace
+// separated. The file is memory mapped, cut into series on line triplet
+// boundaries, and the series are then parsed in parallel.
+
+// The whitespace std::istringstream splits tokens on.
+inline bool job_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Calls fn(begin, end) for every token of [p, end).
+template <typename Function>
+inline void for_each_token(const char* p, const char* end, Function fn) {
+    while (true) {
+        while (p < end && job_space(*p)) {
+            ++p;
+        }
+        if (p == end) {
+            return;
+        }
+        const char* token = p;
+        while (p < end && !job_space(*p)) {
+            ++p;
+        }
+        fn(token, p);
+    }
+}
+
+inline std::size_t count_tokens(const char* p, const char* end) {
+    std::size_t count = 0;
+    for_each_token(p, end, [&count](const char*, const char*) { ++count; });
+    return count;
+}
+
+// Parses the longest numeric prefix of a token and yields 0 if there is
+// none, like atof and atoi do.
+template <typename Number>
+inline Number parse_number(const char* begin, const char* end) {
+    if (begin < end && *begin == '+') {
+        ++begin;
+    }
+    Number value = 0;
+    if (std::from_chars(begin, end, value).ec != std::errc()) {
+        value = 0;
+    }
+    return value;
+}
+
+// Lines of one series: tag line, return times and absolute times. Each end
+// points at the line's newline (or the end of the file).
+struct job_record {
+    const char* begin[3];
+    const char* end[3];
+};
+
+// Parses the .job text file fname.
+std::vector<taggedTS> load_TSjob(std::string fname, int verbose) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::shared_ptr<const mapped_file> file = mapped_file::open(fname);
+    if (!file) {
+        cout << "No such file \"" << fname << "\" in folder." << endl;
+        abort();
+    }
+
+    // Split into line triplets; an incomplete last triplet is ignored.
+    std::vector<job_record> records;
+    const char* p = file->data;
+    const char* end = file->data + file->size;
+    job_record record;
+    int line = 0;
+    while (p < end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* line_end = newline ? newline : end;
+        record.begin[line] = p;
+        record.end[line] = line_end;
+        if (++line == 3) {
+            records.push_back(record);
+            line = 0;
+        }
+        p = newline ? newline + 1 : end;
+    }
+
+    std::vector<taggedTS> tsbuffer(records.size());
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const job_record& r = records[i];
+        taggedTS& current_ts = tsbuffer[i];
+
+        // get the title and UID; a missing UID repeats the tag.
+        std::vector<std::string> names;
+        for_each_token(r.begin[0], r.end[0], [&names](const char* b, const char* e) {
+            if (names.size() < 2) {
+                names.emplace_back(b, e);
+            }
+        });
+        if (!names.empty()) {
+            current_ts.ts_tag = names[0];
+            current_ts.UID = names.back();
+        }
+
+        // get the return times
+        std::vector<double> ret_data;
+        ret_data.reserve(count_tokens(r.begin[1], r.end[1]));
+        for_each_token(r.begin[1], r.end[1], [&ret_data](const char* b, const char* e) {
+            ret_data.push_back(parse_number<double>(b, e));
+        });
+
+        // get the absolute times
+        current_ts.ts_abs_data.reserve(count_tokens(r.begin[2], r.end[2]));
+        for_each_token(r.begin[2], r.end[2], [&current_ts](const char* b, const char* e) {
+            current_ts.ts_abs_data.push_back(parse_number<int>(b, e));
+        });
+
+        // set the taggedTS id.
+        current_ts.id = global_id + i;
+
+        prepare_TS(current_ts, std::move(ret_data));
+    }
+    global_id += records.size();
+
+    if (verbose) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        cout << "processed: " <<
+            tsbuffer.size() <<
+            " vectors in file " <<
+            fname.c_str() <<
+            " (" << file->size / 1e6 / seconds << " MB/s)\n";
+    }
+
+    return tsbuffer;
+}
+
+#endif
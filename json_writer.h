@@ -0,0 +1,108 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// Appends JSON to a string buffer, taking care of the commas between
+// elements. Pretty output puts every value and bracket on a line of its
+// own; compact output has no whitespace at all. Nothing is written to a
+// stream, so separate parts of a document can be formatted concurrently and
+// joined afterwards with raw().
+struct json_writer {
+    std::string out;
+    bool compact;
+
+    explicit json_writer(bool compact) : compact(compact) {
+        first.push_back(true);
+    }
+
+    // Opens an object ('{') or array ('['), as the value of key unless key
+    // is NULL.
+    void begin(const char* key, char bracket) {
+        separate();
+        if (key) {
+            quoted_key(key);
+        }
+        out += bracket;
+        first.push_back(true);
+    }
+
+    void end(char bracket) {
+        first.pop_back();
+        if (!compact) {
+            out += '\n';
+        }
+        out += bracket;
+    }
+
+    void field(const char* key, const std::string& value) {
+        separate();
+        quoted_key(key);
+        quote(value);
+    }
+
+    void field(const char* key, double value) {
+        separate();
+        quoted_key(key);
+        char buffer[64];
+        int length = std::snprintf(buffer, sizeof(buffer), "%f", value);
+        out.append(buffer, length);
+    }
+
+    void field(const char* key, long value) {
+        separate();
+        quoted_key(key);
+        out += std::to_string(value);
+    }
+
+    // Adds an already formatted value.
+    void raw(const std::string& value) {
+        separate();
+        out += value;
+    }
+
+private:
+    // Per open bracket, whether nothing has been written inside it yet.
+    std::vector<bool> first;
+
+    void separate() {
+        if (!first.back()) {
+            out += ',';
+        }
+        if (!compact && first.size() > 1) {
+            out += '\n';
+        }
+        first.back() = false;
+    }
+
+    void quoted_key(const char* key) {
+        quote(key);
+        out += compact ? ":" : " : ";
+    }
+
+    void quote(const std::string& str) {
+        out += '"';
+        for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
+            switch (*c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\t': out += "\\t"; break;
+                case '\r': out += "\\r"; break;
+                default:
+                    if (static_cast<unsigned char>(*c) < 0x20) {
+                        char buffer[8];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04x", *c);
+                        out += buffer;
+                    } else {
+                        out += *c;
+                    }
+            }
+        }
+        out += '"';
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef LOWER_BOUNDS_H
+#define LOWER_BOUNDS_H
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+// Lower bounds on the DTW distance between two 1-D series under the
+// point-wise |x - y| cost (what EuclideanDistance computes in one dimension).
+// FastDTW only evaluates a subset of the warp paths that exact DTW considers,
+// so anything bounding exact DTW from below also bounds fastDTWdist.
+
+// LB_Kim (first/last variant); every warp path starts in cell (0,0) and ends
+// in cell (n-1,m-1), so both of those cells are always paid for.
+inline double lb_kim(const double* q, std::size_t n,
+                     const double* c, std::size_t m)
+{
+    double lb = std::fabs(q[0] - c[0]);
+    if (n > 1 || m > 1)
+    {
+        lb += std::fabs(q[n-1] - c[m-1]);
+    }
+    return lb;
+}
+
+// Smallest and largest value of a series.
+inline void value_range(const double* c, std::size_t m,
+                        double& lower, double& upper)
+{
+    lower = upper = c[0];
+    for (std::size_t j = 1; j < m; ++j)
+    {
+        lower = std::min(lower, c[j]);
+        upper = std::max(upper, c[j]);
+    }
+}
+
+// LB_Keogh against an envelope covering the whole candidate, which is the
+// only envelope that is valid for an unconstrained warp path. Every query
+// point is matched to at least one candidate point, and therefore costs at
+// least its distance to the envelope.
+// Stops early and returns the partial sum once it exceeds cutoff.
+inline double lb_keogh(const double* q, std::size_t n,
+                       double lower, double upper, double cutoff)
+{
+    double lb = 0.0;
+    for (std::size_t i = 0; i < n && lb <= cutoff; ++i)
+    {
+        if (q[i] > upper)
+        {
+            lb += q[i] - upper;
+        }
+        else if (q[i] < lower)
+        {
+            lb += lower - q[i];
+        }
+    }
+    return lb;
+}
+
+// Envelope of c under a band of the cost matrix: lower[i] and upper[i] are
+// the smallest and largest of c[lo[i]..hi[i]], for i < n. lo and hi must
+// never decrease, so the window slides forward over c and two monotonic
+// queues (each with room for hi[n-1]+1 indices) give all n envelopes in
+// linear time.
+inline void band_envelope(const double* c, const std::size_t* lo,
+                          const std::size_t* hi, std::size_t n,
+                          double* lower, double* upper,
+                          std::size_t* min_queue, std::size_t* max_queue)
+{
+    std::size_t min_head = 0, min_tail = 0;
+    std::size_t max_head = 0, max_tail = 0;
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        for (; next <= hi[i]; ++next)
+        {
+            while (min_tail > min_head && c[min_queue[min_tail - 1]] >= c[next])
+            {
+                --min_tail;
+            }
+            min_queue[min_tail++] = next;
+            while (max_tail > max_head && c[max_queue[max_tail - 1]] <= c[next])
+            {
+                --max_tail;
+            }
+            max_queue[max_tail++] = next;
+        }
+        while (min_queue[min_head] < lo[i])
+        {
+            ++min_head;
+        }
+        while (max_queue[max_head] < lo[i])
+        {
+            ++max_head;
+        }
+        lower[i] = c[min_queue[min_head]];
+        upper[i] = c[max_queue[max_head]];
+    }
+}
+
+// The band of the transposed cost matrix: a band of rows lo[i]..hi[i] in
+// each of n columns, covering all m rows, as the columns ilo[j]..ihi[j] of
+// each row j < m. lo and hi must never decrease.
+inline void transpose_band(const std::size_t* lo, const std::size_t* hi,
+                           std::size_t n, std::size_t m,
+                           std::size_t* ilo, std::size_t* ihi)
+{
+    std::size_t first = 0, last = 0;
+    for (std::size_t j = 0; j < m; ++j)
+    {
+        while (hi[first] < j)
+        {
+            ++first;
+        }
+        while (last + 1 < n && lo[last + 1] <= j)
+        {
+            ++last;
+        }
+        ilo[j] = first;
+        ihi[j] = last;
+    }
+}
+
+// LB_Keogh for DTW constrained to a band: every query point i is matched to
+// at least one candidate point inside its envelope lower[i]..upper[i] (see
+// band_envelope), and therefore costs at least its distance to it. Only a
+// bound on DTW within that band, not on unconstrained DTW or FastDTW.
+// Stops early and returns the partial sum once it exceeds cutoff.
+inline double lb_keogh_band(const double* q, std::size_t n,
+                            const double* lower, const double* upper,
+                            double cutoff)
+{
+    double lb = 0.0;
+    for (std::size_t i = 0; i < n && lb <= cutoff; ++i)
+    {
+        if (q[i] > upper[i])
+        {
+            lb += q[i] - upper[i];
+        }
+        else if (q[i] < lower[i])
+        {
+            lb += lower[i] - q[i];
+        }
+    }
+    return lb;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. Pages are only read from disk
+// when they are touched; the mapping goes away with its last owner.
+struct mapped_file {
+    const char* data;
+    std::size_t size;
+
+    // Returns an empty pointer if the file cannot be opened or mapped.
+    static std::shared_ptr<const mapped_file> open(const std::string& fname) {
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::shared_ptr<const mapped_file>();
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return std::shared_ptr<const mapped_file>();
+        }
+        std::shared_ptr<mapped_file> file(new mapped_file());
+        file->size = st.st_size;
+        if (file->size > 0) {
+            void* addr = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                return std::shared_ptr<const mapped_file>();
+            }
+            file->data = static_cast<const char*>(addr);
+        }
+        // The mapping stays valid after the descriptor is closed.
+        ::close(fd);
+        return file;
+    }
+
+    ~mapped_file() {
+        if (data) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+private:
+    mapped_file() : data(NULL), size(0) {}
+    mapped_file(const mapped_file&);
+    mapped_file& operator=(const mapped_file&);
+};
+
+// Shared read-write memory mapping of a file created or truncated to size
+// zero bytes. What is written to data ends up in the file; the pages are
+// written back by the kernel, at the latest when the mapping goes away with
+// its last owner, or by sync().
+struct mapped_output_file {
+    char* data;
+    std::size_t size;
+
+    // Returns an empty pointer if the file cannot be created or mapped, or
+    // the disk has no room for size bytes. The space is reserved up front,
+    // so that writing to data cannot run out of it (which would raise
+    // SIGBUS rather than fail).
+    static std::shared_ptr<mapped_output_file> create(const std::string& fname, std::size_t size) {
+        int fd = ::open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return std::shared_ptr<mapped_output_file>();
+        }
+        if (size > 0 && posix_fallocate(fd, 0, size) != 0) {
+            ::close(fd);
+            return std::shared_ptr<mapped_output_file>();
+        }
+        std::shared_ptr<mapped_output_file> file(new mapped_output_file());
+        file->size = size;
+        if (file->size > 0) {
+            void* addr = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                return std::shared_ptr<mapped_output_file>();
+            }
+            file->data = static_cast<char*>(addr);
+        }
+        ::close(fd);
+        return file;
+    }
+
+    // Writes bytes first...first+length-1 of data back to the file and waits
+    // for them to get there. Returns false if they could not be written.
+    bool sync(std::size_t first, std::size_t length) {
+        if (length == 0) {
+            return true;
+        }
+        // msync takes whole pages.
+        std::size_t page = sysconf(_SC_PAGESIZE);
+        std::size_t start = first / page * page;
+        return msync(data + start, first + length - start, MS_SYNC) == 0;
+    }
+
+    ~mapped_output_file() {
+        if (data) {
+            munmap(data, size);
+        }
+    }
+
+private:
+    mapped_output_file() : data(NULL), size(0) {}
+    mapped_output_file(const mapped_output_file&);
+    mapped_output_file& operator=(const mapped_output_file&);
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef NN_FUNCTIONS_H
+#define NN_FUNCTIONS_H
+
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -7,264 +10,1021 @@
 #include <tuple>
 #include <numeric>
 #include <map>
+#include <limits>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#include <optional>
+#include <mutex>
+#include <omp.h>
 
 #include "DTW.h"
 #include "FastDTW.h"
+#include "DTWStatistics.h"
+#include "SakoeChibaWindow.h"
 #include "EuclideanDistance.h"
+#include "lower_bounds.h"
+#include "tagged_ts.h"
+#include "ts_binary.h"
+#include "job_text.h"
+#include "json_writer.h"
+#include "work_stealing.h"
+#include "distance_cache.h"
 
-#define WINDOW_WIDTH 20
+// Cheapest candidate cost, relative to the most expensive one, that still
+// joins a batch; see one_NN_many.
+#define BATCH_COST_RATIO 0.9
 
-// Identity std::to_string
-namespace std
-{
-    std::string to_string(std::string str)
-    {
-        return str;
-    }
-}
-// Double quote a string
-// alfa --> "alfa"
-auto qs = [](std::string str)
-{
-    return "\"" + str + "\"";
-};
-// Create a key-value pair for json
-// alfa, beta --> alfa : beta,\n
-auto kv = [](std::string str, auto value, bool comma = true)
-{
-    cout << str << " : " << std::to_string(value) << (comma ? "," : "") << endl;
-};
-// Create an array or object for json
-auto wrp = [](std::string pre, auto wrapped, std::string post, bool comma = false)
-{
-    cout << pre << endl;
-    wrapped();
-    cout << post << (comma ? "," : "") << endl;
+using namespace fastdtw;
+
+// Distance the series are compared under, see --algorithm.
+enum dtw_algorithm {
+    // FastDTW with a search radius of radius.
+    ALGORITHM_FASTDTW,
+    // Exact DTW within a Sakoe-Chiba band of radius rows.
+    ALGORITHM_CDTW,
+    // Exact, unconstrained DTW.
+    ALGORITHM_FULL
 };
 
-using namespace fastdtw;
+struct dtw_settings {
+    dtw_algorithm algorithm;
+    int radius;
+};
 
-struct taggedTS {
-    std::vector<double> ts_ret_data;
-    std::vector<int> ts_abs_data;
-    std::string ts_tag;
-    int id;
-    std::string UID;
+// What one_NN_many reports, and how it compares the series.
+struct nn_options {
+    // Number of nearest neighbours reported per query, 0 for every reference.
+    std::size_t k;
+    // Compare in single precision (the series have to be narrowed, see
+    // narrow_TS).
+    bool use_float;
+    // Recompute every reported distance in double and report how far off
+    // the single precision ones were.
+    bool validate_precision;
+    // Write the results as compact JSON.
+    bool compact;
+    int verbose;
+    // Unless NULL, execution statistics are written to it, see write_stats.
+    const char* stats_filename;
 };
 
-double fastDTWdist (taggedTS query,
-                    taggedTS candidate,
-                    int use_time_domain,
-                    int print_warp_path) {
+// Name of algorithm as given to --algorithm.
+const char* algorithm_name(dtw_algorithm algorithm) {
+    switch (algorithm) {
+        case ALGORITHM_CDTW:
+            return "cdtw";
+        case ALGORITHM_FULL:
+            return "full";
+        case ALGORITHM_FASTDTW:
+            break;
+    }
+    return "fastdtw";
+}
 
+// Number of leading points of ts that take part in a comparison against a
+// series ending at other_end (absolute time). Without the time domain every
+// point is used; with it we stop at the first point past the other series.
+std::size_t prefix_length(const taggedTS& ts,
+                          int other_end,
+                          int use_time_domain) {
+    if (!use_time_domain) {
+        return ts.series.size();
+    }
+    if (ts.abs_sorted) {
+        return std::upper_bound(ts.ts_abs_data.begin(), ts.ts_abs_data.end(),
+                                other_end) - ts.ts_abs_data.begin();
+    }
+    std::size_t length = 0;
+    while (length < std::size_t(ts.series.size())) {
+        if (use_time_domain && ts.ts_abs_data[length] > other_end) {
+            break;
+        }
+        ++length;
+    }
+    return length;
+}
+
+// Numbers of leading points of query and candidate that are compared with
+// each other, see prefix_length.
+void compared_lengths(const taggedTS& query,
+                      const taggedTS& candidate,
+                      int use_time_domain,
+                      std::size_t& query_length,
+                      std::size_t& candidate_length) {
+    if (!use_time_domain) {
+        query_length = query.series.size();
+        candidate_length = candidate.series.size();
+        return;
+    }
     int query_end = query.ts_abs_data[query.ts_abs_data.size() - 1];
     int candidate_end = candidate.ts_abs_data[candidate.ts_abs_data.size() - 1];
+    query_length = prefix_length(query, candidate_end, use_time_domain);
+    candidate_length = prefix_length(candidate, query_end, use_time_domain);
+}
 
-    TimeSeries<double,1> tsI, tsJ;
-
-    for (int i = 0; i<query.ts_ret_data.size(); ++i) {
-        if (use_time_domain && query.ts_abs_data[i] > candidate_end) {
-            break; // if the query goes on longer than the candidate, quit early
-        }
-        tsI.addLast(i, TimeSeriesPoint<double,1>(&(query.ts_ret_data)[i]));
+// cutoff in ValueType precision, rounded up so that a comparison in
+// ValueType is never abandoned where one in double would have finished.
+template <typename ValueType>
+ValueType narrow_cutoff(double cutoff) {
+    if (cutoff > std::numeric_limits<ValueType>::max()) {
+        return std::numeric_limits<ValueType>::infinity();
+    }
+    ValueType narrowed = static_cast<ValueType>(cutoff);
+    if (narrowed < cutoff) {
+        narrowed = std::nextafter(narrowed, std::numeric_limits<ValueType>::infinity());
     }
+    return narrowed;
+}
 
-    for (int i = 0; i<candidate.ts_ret_data.size(); ++i) {
-        if (use_time_domain && candidate.ts_abs_data[i] > query_end) {
-            break; // if the candidate goes on longer than the query, quit early
-        }
-        tsJ.addLast(i, TimeSeriesPoint<double,1>(&(candidate.ts_ret_data)[i]));
+// A distance computed in ValueType precision as a double, keeping an
+// abandoned comparison recognisable as STRI::abandonedDistance<double>().
+template <typename ValueType>
+double widen_distance(ValueType distance) {
+    if (distance == STRI::abandonedDistance<ValueType>()) {
+        return STRI::abandonedDistance<double>();
     }
+    return distance;
+}
+
+// Returns the FastDTW distance with the given search radius, or
+// STRI::abandonedDistance<double>() as soon as it is known to exceed cutoff.
+// The series and the cost matrices are held in ValueType precision, see
+// taggedTS::get_series.
+template <typename ValueType = double>
+double fastDTWdist (const taggedTS& query,
+                    const taggedTS& candidate,
+                    int use_time_domain,
+                    int radius,
+                    int print_warp_path,
+                    double cutoff) {
+
+    std::size_t query_length, candidate_length;
+    compared_lengths(query, candidate, use_time_domain, query_length, candidate_length);
+
+    TimeSeries<ValueType,1> tsI(query.get_series<ValueType>(), query_length);
+    TimeSeries<ValueType,1> tsJ(candidate.get_series<ValueType>(), candidate_length);
 
     if (tsI.size() == 0 || tsJ.size() == 0) {
         cout << "Timeseries of size 0 compared; exiting." << endl;
         abort();
     }
 
-    TimeWarpInfo<double> info =
-      FAST::getWarpInfoBetween(tsI,tsJ,WINDOW_WIDTH,EuclideanDistance());
-
     if (print_warp_path) {
+        TimeWarpInfo<ValueType> info =
+          FAST::getWarpInfoBetween(tsI,tsJ,radius,EuclideanDistance(),
+                                   narrow_cutoff<ValueType>(cutoff));
         info.getPath()->print(std::cout);
+        return widen_distance(info.getDistance());
     }
 
-    return info.getDistance();
+    // Without a warp path to print there is no need to materialise one.
+    // The cached coarser resolutions only apply to a series used in full.
+    const PAAPyramid<ValueType,1>* pyramidI =
+      query_length == std::size_t(query.series.size()) ? &query.get_pyramid<ValueType>() : NULL;
+    const PAAPyramid<ValueType,1>* pyramidJ =
+      candidate_length == std::size_t(candidate.series.size()) ?
+        &candidate.get_pyramid<ValueType>() : NULL;
+    return widen_distance(
+      FAST::getWarpDistBetween(tsI,pyramidI,tsJ,pyramidJ,radius,EuclideanDistance(),
+                               narrow_cutoff<ValueType>(cutoff)));
 }
 
-double fastDTWdist (taggedTS query,
-                    taggedTS candidate,
-                    int use_time_domain) {
-    return fastDTWdist(query, candidate, use_time_domain, 0);
-}
+// Returns the distance under settings.algorithm, or
+// STRI::abandonedDistance<double>() as soon as it is known to exceed cutoff.
+// FastDTW goes through fastDTWdist; the exact algorithms fill the cost
+// matrix within a Sakoe-Chiba band or in full. Computed in ValueType
+// precision like fastDTWdist.
+template <typename ValueType = double>
+double DTWdist (const taggedTS& query,
+                const taggedTS& candidate,
+                int use_time_domain,
+                const dtw_settings& settings,
+                int print_warp_path,
+                double cutoff) {
 
-// TODO: perhaps find a better way to keep track of this.
-int global_id = 0;
+    if (settings.algorithm == ALGORITHM_FASTDTW) {
+        return fastDTWdist<ValueType>(query, candidate, use_time_domain, settings.radius,
+                                      print_warp_path, cutoff);
+    }
+
+    std::size_t query_length, candidate_length;
+    compared_lengths(query, candidate, use_time_domain, query_length, candidate_length);
 
-std::vector<taggedTS> load_TSfile(std::string fname, int verbose) {
-    std::ifstream jobfile (fname.c_str(), std::ifstream::in);
+    TimeSeries<ValueType,1> tsI(query.get_series<ValueType>(), query_length);
+    TimeSeries<ValueType,1> tsJ(candidate.get_series<ValueType>(), candidate_length);
 
-    if (!jobfile) {
-        cout << "No such file \"" << fname << "\" in folder." << endl;
+    if (tsI.size() == 0 || tsJ.size() == 0) {
+        cout << "Timeseries of size 0 compared; exiting." << endl;
         abort();
     }
 
-    std::string tag_line;
-    std::string ret_time_line;
-    std::string abs_time_line;
-    std::string tok;
-    std::vector <taggedTS> tsbuffer;
+    ValueType narrowed = narrow_cutoff<ValueType>(cutoff);
+    if (settings.algorithm == ALGORITHM_CDTW) {
+        SakoeChibaWindow band(tsI, tsJ, settings.radius);
+        DTWStatistics::local().addPass(0, band.size());
+        if (print_warp_path) {
+            TimeWarpInfo<ValueType> info =
+              STRI::getWarpInfoBetween(tsI,tsJ,band,EuclideanDistance(),narrowed);
+            info.getPath()->print(std::cout);
+            return widen_distance(info.getDistance());
+        }
+        return widen_distance(STRI::getWarpDistBetween(tsI,tsJ,band,EuclideanDistance(),narrowed));
+    }
+
+    DTWStatistics::local().addPass(0, (JLong)tsI.size() * tsJ.size());
+    if (print_warp_path) {
+        TimeWarpInfo<ValueType> info = STRI::getWarpInfoBetween(tsI,tsJ,EuclideanDistance());
+        info.getPath()->print(std::cout);
+        return widen_distance(info.getDistance());
+    }
+    return widen_distance(STRI::getWarpDistBetween(tsI,tsJ,EuclideanDistance(),narrowed));
+}
 
-    //get lines in groups of three - tag lines, return lines, abs time lines.
-    while (std::getline(jobfile, tag_line)      &&
-           std::getline(jobfile, ret_time_line) &&
-           std::getline(jobfile, abs_time_line)) {
+// Lanes of STRI::getWarpDistsBetween in ValueType precision on top of lanes
+// that work in double, see narrow_cutoff and widen_distance.
+template <typename ValueType, typename Lanes>
+struct narrowed_lanes {
+    Lanes& lanes;
 
-        taggedTS current_ts;
+    ValueType cutoff(JInt c) {
+        return narrow_cutoff<ValueType>(lanes.cutoff(c));
+    }
 
-        // get the title and UID
-        std::istringstream line_iss(tag_line);
-        line_iss >> tok;
-        current_ts.ts_tag = tok;
-        line_iss >> tok;
-        current_ts.UID = tok;
+    void result(JInt c, ValueType distance) {
+        lanes.result(c, widen_distance(distance));
+    }
+};
+
+// DTWdist of query against count <= STRI::BATCH_LANES candidates at once.
+// Under FastDTW and cdtw the full resolution passes run side by side in
+// vector lanes, as far as their windows line up (see
+// STRI::getWarpDistsBetween): under cdtw the bands of candidates of similar
+// lengths do. The exact unconstrained DTW compares one candidate after the
+// other. lanes.cutoff(c) gives candidate c's cutoff when its comparison
+// starts and lanes.result(c, distance) takes its distance, abandoned past
+// the cutoff like DTWdist's result, as soon as it is known. Both are in
+// double, whatever ValueType the comparisons run in.
+template <typename ValueType, typename Lanes>
+void DTWdist_batch (const taggedTS& query,
+                    const taggedTS* const* candidates,
+                    std::size_t count,
+                    int use_time_domain,
+                    const dtw_settings& settings,
+                    Lanes& lanes) {
 
-        // get the return times
-        std::istringstream ret_iss(ret_time_line);
-        while (ret_iss >> tok) {
-            current_ts.ts_ret_data.push_back(std::atof(tok.c_str()));
+    if (count == 1 || settings.algorithm == ALGORITHM_FULL) {
+        for (std::size_t c = 0; c < count; ++c) {
+            double cutoff = lanes.cutoff(c);
+            lanes.result(c, DTWdist<ValueType>(query, *candidates[c], use_time_domain, settings,
+                                               0, cutoff));
         }
+        return;
+    }
 
-        // get the absolute times
-        std::istringstream abs_iss(abs_time_line);
-        while (abs_iss >> tok) {
-            current_ts.ts_abs_data.push_back(std::atoi(tok.c_str()));
+    std::optional<TimeSeries<ValueType,1> > queries[STRI::BATCH_LANES];
+    std::optional<TimeSeries<ValueType,1> > references[STRI::BATCH_LANES];
+    const TimeSeries<ValueType,1>* tsI[STRI::BATCH_LANES];
+    const TimeSeries<ValueType,1>* tsJ[STRI::BATCH_LANES];
+    const PAAPyramid<ValueType,1>* pyramidI[STRI::BATCH_LANES];
+    const PAAPyramid<ValueType,1>* pyramidJ[STRI::BATCH_LANES];
+    for (std::size_t c = 0; c < count; ++c) {
+        const taggedTS& candidate = *candidates[c];
+        std::size_t query_length, candidate_length;
+        compared_lengths(query, candidate, use_time_domain, query_length, candidate_length);
+        if (query_length == 0 || candidate_length == 0) {
+            cout << "Timeseries of size 0 compared; exiting." << endl;
+            abort();
         }
+        queries[c].emplace(query.get_series<ValueType>(), query_length);
+        references[c].emplace(candidate.get_series<ValueType>(), candidate_length);
+        tsI[c] = &*queries[c];
+        tsJ[c] = &*references[c];
+        pyramidI[c] = query_length == std::size_t(query.series.size()) ?
+          &query.get_pyramid<ValueType>() : NULL;
+        pyramidJ[c] = candidate_length == std::size_t(candidate.series.size()) ?
+          &candidate.get_pyramid<ValueType>() : NULL;
+    }
+    narrowed_lanes<ValueType, Lanes> narrowed = {lanes};
+    if (settings.algorithm == ALGORITHM_FASTDTW) {
+        FAST::getWarpDistsBetween(tsI, pyramidI, tsJ, pyramidJ, count, settings.radius,
+                                  EuclideanDistance(), narrowed);
+        return;
+    }
 
-        // set the taggedTS id.
-        current_ts.id = global_id++;
+    std::optional<SakoeChibaWindow> bands[STRI::BATCH_LANES];
+    const SearchWindow* windows[STRI::BATCH_LANES];
+    for (std::size_t c = 0; c < count; ++c) {
+        bands[c].emplace(*tsI[c], *tsJ[c], settings.radius);
+        windows[c] = &*bands[c];
+        DTWStatistics::local().addPass(0, bands[c]->size());
+    }
+    STRI::getWarpDistsBetween(tsI, tsJ, windows, count, EuclideanDistance(), narrowed);
+}
 
-        // push the completed taggedTS and increase the count.
-        tsbuffer.push_back(current_ts);
+double DTWdist (const taggedTS& query,
+                const taggedTS& candidate,
+                int use_time_domain,
+                const dtw_settings& settings) {
+    return DTWdist(query, candidate, use_time_domain, settings, 0,
+                   std::numeric_limits<double>::max());
+}
+
+// Loads a .job file or its binary form. The absolute times are only needed
+// in the time domain or for hashing the series; a binary file leaves them
+// undecoded without load_times, see load_TSbinary.
+std::vector<taggedTS> load_TSfile(std::string fname, int verbose, bool load_times = true) {
+    // Files converted with job2bin are mapped instead of parsed.
+    if (is_TSbinary(fname)) {
+        return load_TSbinary(fname, verbose, load_times);
     }
 
-    if (verbose) {
-        cout << "processed: " <<
-            tsbuffer.size() <<
-            " vectors in file " <<
-            fname.c_str() << "\n";
+    return load_TSjob(fname, verbose);
+}
+
+// Stage of the lower bound cascade that eliminated a candidate.
+enum prune_stage {
+    NOT_PRUNED,
+    PRUNED_BY_KIM,
+    PRUNED_BY_KEOGH
+};
+
+// Number of candidates answered by the distance cache, eliminated by each
+// stage of the cascade, the number that went through fastDTWdist, and how
+// many of those were abandoned part-way because they could no longer beat
+// the threshold.
+struct prune_counters {
+    long cached = 0;
+    long kim = 0;
+    long keogh = 0;
+    long computed = 0;
+    long abandoned = 0;
+
+    void add(const prune_counters& other) {
+        cached += other.cached;
+        kim += other.kim;
+        keogh += other.keogh;
+        computed += other.computed;
+        abandoned += other.abandoned;
     }
+};
 
-    return tsbuffer;
+// Work done for one query, summed over the threads that compared it; see
+// --stats. Times are omp_get_wtime() seconds.
+struct query_stats {
+    prune_counters counters;
+    // time spent in the query's comparisons, summed over threads
+    double seconds = 0;
+    // when the first of them started and the last one ended
+    double first_start = std::numeric_limits<double>::infinity();
+    double last_end = -std::numeric_limits<double>::infinity();
+    DTWStatistics dtw;
+
+    void add(const prune_counters& task, double start, double end, const DTWStatistics& work) {
+        counters.add(task);
+        seconds += end - start;
+        first_start = std::min(first_start, start);
+        last_end = std::max(last_end, end);
+        dtw.merge(work);
+    }
+};
+
+// LB_Keogh of the n points of q and the m points of c within the
+// Sakoe-Chiba band of the given radius, the tighter of the bounds in both
+// directions as far as it was needed to exceed threshold.
+double lb_keogh_cdtw(const double* q, std::size_t n,
+                     const double* c, std::size_t m,
+                     int radius, double threshold) {
+    TimeSeries<double,1> tsI(q, n);
+    TimeSeries<double,1> tsJ(c, m);
+    SakoeChibaWindow band(tsI, tsJ, radius);
+    std::size_t longest = std::max(n, m);
+    WorkspaceBuffer<std::size_t> lo(longest), hi(longest);
+    WorkspaceBuffer<std::size_t> min_queue(longest), max_queue(longest);
+    WorkspaceBuffer<double> lower(longest), upper(longest);
+    for (std::size_t i = 0; i < n; ++i) {
+        (*lo)[i] = band.minJForI(i);
+        (*hi)[i] = band.maxJForI(i);
+    }
+    band_envelope(c, lo->data(), hi->data(), n, lower->data(), upper->data(),
+                  min_queue->data(), max_queue->data());
+    double lb = lb_keogh_band(q, n, lower->data(), upper->data(), threshold);
+    if (lb > threshold) {
+        return lb;
+    }
+    // The same band seen from the candidate's side.
+    WorkspaceBuffer<std::size_t> ilo(m), ihi(m);
+    transpose_band(lo->data(), hi->data(), n, m, ilo->data(), ihi->data());
+    band_envelope(q, ilo->data(), ihi->data(), m, lower->data(), upper->data(),
+                  min_queue->data(), max_queue->data());
+    return std::max(lb, lb_keogh_band(c, m, lower->data(), upper->data(), threshold));
 }
 
-//compares query against dataset. returns 1 if
-//predicted value is correct, 0 o/w.
-void kNN_worker(taggedTS query,
-                  std::vector<taggedTS> dataset,
-                  std::vector<std::tuple<double, taggedTS>>& results,
-                  int use_time_domain) {
+// Decides whether candidate provably cannot get closer to query than
+// threshold under settings.algorithm, trying the constant-time LB_Kim
+// before the linear LB_Keogh.
+prune_stage lb_cascade(const taggedTS& query,
+                       const taggedTS& candidate,
+                       int use_time_domain,
+                       const dtw_settings& settings,
+                       double threshold) {
 
-	#pragma omp parallel for
-    for (int i = 0; i < dataset.size(); ++i) 
-	{
-        double this_result = fastDTWdist(query, dataset[i], use_time_domain);
+    std::size_t n, m;
+    compared_lengths(query, candidate, use_time_domain, n, m);
+    if (n == 0 || m == 0) {
+        return NOT_PRUNED; // let DTWdist report it
+    }
+    const double* q = query.series.data();
+    const double* c = candidate.series.data();
 
-		#pragma omp critical
-        {
-            results.emplace_back(this_result, dataset[i]);
+    if (lb_kim(q, n, c, m) > threshold) {
+        return PRUNED_BY_KIM;
+    }
+
+    // Within a band every point can only be matched to the points the band
+    // lets through, which gives an envelope per point.
+    if (settings.algorithm == ALGORITHM_CDTW) {
+        if (lb_keogh_cdtw(q, n, c, m, settings.radius, threshold) > threshold) {
+            return PRUNED_BY_KEOGH;
         }
+        return NOT_PRUNED;
+    }
+
+    // Both series have to be covered by the warp path, so the bound holds
+    // in either direction.
+    double lower, upper;
+    value_range(c, m, lower, upper);
+    if (lb_keogh(q, n, lower, upper, threshold) > threshold) {
+        return PRUNED_BY_KEOGH;
+    }
+    value_range(q, n, lower, upper);
+    if (lb_keogh(c, m, lower, upper, threshold) > threshold) {
+        return PRUNED_BY_KEOGH;
     }
+    return NOT_PRUNED;
 }
 
-// compares query against dataset.
-void kNN_single(taggedTS query,
-                std::vector<taggedTS> dataset,
+// Bounded max-heap of the k nearest (distance, neighbour) pairs offered so
+// far. Neighbours point into the reference dataset, which has to outlive the
+// heap. Ties in distance are broken on the id, so the kept set does not
+// depend on the order in which threads offer their results.
+struct neighbour_heap {
+    typedef std::tuple<double, const taggedTS*> entry;
+
+    std::size_t k;
+    std::vector<entry> entries;
+
+    explicit neighbour_heap(std::size_t k) : k(k) {
+        entries.reserve(k);
+    }
+
+    static bool closer(const entry& a, const entry& b) {
+        if (std::get<0>(a) != std::get<0>(b)) {
+            return std::get<0>(a) < std::get<0>(b);
+        }
+        return std::get<1>(a)->id < std::get<1>(b)->id;
+    }
+
+    // Distance a candidate has to beat to get in; infinite until k
+    // neighbours have been found.
+    double threshold() const {
+        if (entries.size() < k) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return std::get<0>(entries.front());
+    }
+
+    void offer(double distance, const taggedTS& neighbour) {
+        if (k == 0) {
+            return;
+        }
+        entry candidate(distance, &neighbour);
+        if (entries.size() == k) {
+            if (!closer(candidate, entries.front())) {
+                return;
+            }
+            std::pop_heap(entries.begin(), entries.end(), closer);
+            entries.pop_back();
+        }
+        entries.push_back(candidate);
+        std::push_heap(entries.begin(), entries.end(), closer);
+    }
+
+    // The kept neighbours, nearest first. Leaves the heap empty.
+    std::vector<entry> take_sorted() {
+        std::sort_heap(entries.begin(), entries.end(), closer);
+        return std::move(entries);
+    }
+};
+
+// Upper bound on the distance of a query's k-th nearest neighbour, shared
+// by all threads. Every thread keeps neighbours in heaps of its own, and the
+// k-th best of any of them already bounds the overall k-th best, so the
+// smallest of those is a valid pruning threshold. It is only ever lowered.
+struct alignas(64) shared_threshold {
+    std::atomic<double> value;
+
+    shared_threshold() : value(std::numeric_limits<double>::infinity()) {}
+
+    double get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    void lower(double bound) {
+        double current = get();
+        while (bound < current &&
+               !value.compare_exchange_weak(current, bound, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+// Lanes of DTWdist_batch for kNN_worker: every candidate starts with the
+// query's threshold at that moment, and its distance goes to the heap as
+// soon as it is known, lowering the threshold for the candidates after it.
+// With a cache, every distance (or the cutoff it was abandoned at) is added
+// to it for the query.
+struct kNN_lanes {
+    const taggedTS& query;
+    const taggedTS* const* candidates;
+    neighbour_heap& heap;
+    shared_threshold& threshold;
+    prune_counters& counters;
+    distance_cache* cache;
+    double cutoffs[STRI::BATCH_LANES];
+
+    kNN_lanes(const taggedTS& query, const taggedTS* const* candidates, neighbour_heap& heap,
+              shared_threshold& threshold, prune_counters& counters, distance_cache* cache)
+        : query(query), candidates(candidates), heap(heap), threshold(threshold),
+          counters(counters), cache(cache) {}
+
+    double cutoff(JInt c) {
+        return cutoffs[c] = threshold.get();
+    }
+
+    void result(JInt c, double distance) {
+        ++counters.computed;
+        if (cache) {
+            if (distance == STRI::abandonedDistance<double>())
+                cache->add(omp_get_thread_num(), query.content_hash, candidates[c]->content_hash,
+                           CACHE_BOUND, cutoffs[c]);
+            else
+                cache->add(omp_get_thread_num(), query.content_hash, candidates[c]->content_hash,
+                           CACHE_EXACT, distance);
+        }
+        if (distance > cutoffs[c]) {
+            ++counters.abandoned;
+            return;
+        }
+        heap.offer(distance, *candidates[c]);
+        threshold.lower(heap.threshold());
+    }
+};
+
+//compares query against a batch of count <= STRI::BATCH_LANES candidates,
+//offering the distances to the calling thread's heap for the query unless
+//they are pruned or abandoned. Under FastDTW and cdtw the candidates that
+//survive the lower bounds are compared together in ValueType precision, see
+//DTWdist_batch. The exact unconstrained DTW has no batched kernel, so there
+//each candidate is pruned and compared in turn, with the threshold the ones
+//before it left. Unless cache is NULL, candidates whose distance it knows,
+//or knows to exceed the threshold, are not compared at all.
+template <typename ValueType>
+void kNN_worker(const taggedTS& query,
+                const taggedTS* const* candidates,
+                std::size_t count,
+                neighbour_heap& heap,
+                shared_threshold& threshold,
                 int use_time_domain,
-				bool do_modelling) 
+                const dtw_settings& settings,
+                distance_cache* cache,
+                prune_counters& counters) {
+
+    std::size_t batch = settings.algorithm == ALGORITHM_FULL ? 1 : count;
+    for (std::size_t first = 0; first < count; first += batch) {
+        std::size_t last = std::min(first + batch, count);
+
+        // The cached distances go to the heap first, so that the threshold
+        // they leave applies to the cached bounds and the lower bounds.
+        distance_cache_entry cached[STRI::BATCH_LANES];
+        bool known[STRI::BATCH_LANES] = {};
+        for (std::size_t c = first; cache && c < last; ++c) {
+            known[c - first] = cache->find(query.content_hash, candidates[c]->content_hash,
+                                           cached[c - first]);
+            if (known[c - first] && cached[c - first].kind == CACHE_EXACT) {
+                ++counters.cached;
+                heap.offer(cached[c - first].distance, *candidates[c]);
+                threshold.lower(heap.threshold());
+            }
+        }
+        double cutoff = threshold.get();
+
+        const taggedTS* survivors[STRI::BATCH_LANES];
+        std::size_t survivor_count = 0;
+        for (std::size_t c = first; c < last; ++c) {
+            if (known[c - first]) {
+                if (cached[c - first].kind == CACHE_EXACT) {
+                    continue;
+                }
+                if (cached[c - first].kind == CACHE_BOUND && cached[c - first].distance >= cutoff) {
+                    ++counters.cached;
+                    continue;
+                }
+            }
+            switch (lb_cascade(query, *candidates[c], use_time_domain, settings, cutoff)) {
+                case PRUNED_BY_KIM:
+                    ++counters.kim;
+                    break;
+                case PRUNED_BY_KEOGH:
+                    ++counters.keogh;
+                    break;
+                case NOT_PRUNED:
+                    survivors[survivor_count++] = candidates[c];
+                    break;
+            }
+        }
+        if (survivor_count == 0) {
+            continue;
+        }
+
+        kNN_lanes lanes(query, survivors, heap, threshold, counters, cache);
+        DTWdist_batch<ValueType>(query, survivors, survivor_count, use_time_domain, settings, lanes);
+    }
+}
+
+// Whether candidate is compared against query; skip the query itself, and
+// different websites if we are preparing a modelling set.
+bool is_candidate(const taggedTS& query, const taggedTS& candidate, bool do_modelling) {
+    return candidate.UID != query.UID &&
+        !(do_modelling && candidate.ts_tag != query.ts_tag);
+}
+
+// Rough number of cost matrix cells filled for the pair. FastDTW fills a
+// band of radius around the projected path at full resolution, and about as
+// much again over all coarser resolutions; cdtw fills its band once.
+double estimated_cost(const taggedTS& query, const taggedTS& candidate, int use_time_domain,
+                      const dtw_settings& settings) {
+    std::size_t query_length, candidate_length;
+    compared_lengths(query, candidate, use_time_domain, query_length, candidate_length);
+    double n = query_length;
+    double m = candidate_length;
+    switch (settings.algorithm) {
+        case ALGORITHM_FASTDTW:
+            return std::min(n * m, 2.0 * (n + m) * (2 * settings.radius + 1));
+        case ALGORITHM_CDTW:
+            return std::min(n * m, std::max(n, m) + 2.0 * settings.radius * n);
+        case ALGORITHM_FULL:
+            break;
+    }
+    return n * m;
+}
+
+// Formats the result object of one query.
+std::string format_result(const taggedTS& query,
+                          const std::vector<neighbour_heap::entry>& neighbours,
+                          bool compact)
 {
-    // Vector of (distance, timeseries)
-	std::vector<std::tuple<double, taggedTS>> results;
-	// Remove different websites if we are preparing a modelling set.
-	dataset.erase(std::remove_if(
-				dataset.begin(), 
-				dataset.end(),
-				[query, do_modelling](taggedTS x)
-				{
-					return (x.UID == query.UID) || (do_modelling && x.ts_tag != query.ts_tag);
-				}),
-			dataset.end());
-	// Run kNN, filling the above vector
-    kNN_worker(query, dataset, results, use_time_domain);
-    if(results.size() < 1)
-	{
-		wrp(qs("neighbours") + " : [", [](){}, "]", true);
-		return;
-	}
-	// Output the neighbours array
-    wrp(qs("neighbours") + " : [", [&results]()
+    json_writer json(compact);
+    json.begin(NULL, '{');
+    // the neighbours array
+    json.begin("neighbours", '[');
+    for (std::size_t i = 0; i < neighbours.size(); ++i)
     {
-        // Output formatter (outputs a single neighbor)
-        auto outputter = [](bool last)
-        {
-            return [last](std::tuple<double, taggedTS> result)
-            {
-                double distance = std::get<0>(result);
-                taggedTS neighbor = std::get<1>(result);
-                wrp("{", [last, distance, neighbor]()
-                {
-                    kv(qs("distance"), distance);
-                    kv(qs("tag"), qs(neighbor.ts_tag));
-                    kv(qs("UID"), qs(neighbor.UID), false);
-                    //kv(qs("id"), neighbor.id, false);
-                }, "}", !last);
-            };
-        };
-
-        // Output 0...n-1
-        for_each(results.begin(), results.end()-1, outputter(false));
-        // Output n
-        outputter(true)(results.back());
-    }, "]", true);
+        const taggedTS& neighbor = *std::get<1>(neighbours[i]);
+        json.begin(NULL, '{');
+        json.field("distance", std::get<0>(neighbours[i]));
+        json.field("tag", neighbor.ts_tag);
+        json.field("UID", neighbor.UID);
+        json.end('}');
+    }
+    json.end(']');
+    // information on the query itself
+    json.begin("ground_truth", '{');
+    json.field("tag", query.ts_tag);
+    json.field("UID", query.UID);
+    json.end('}');
+    json.end('}');
+    return std::move(json.out);
+}
+
+// Adds the candidate counts of counters to json.
+void format_counters(json_writer& json, std::size_t candidates, const prune_counters& counters) {
+    json.field("candidates", long(candidates));
+    json.field("answered_from_cache", counters.cached);
+    json.field("pruned_by_kim", counters.kim);
+    json.field("pruned_by_keogh", counters.keogh);
+    json.field("compared", counters.computed);
+    json.field("abandoned", counters.abandoned);
+}
+
+// Adds the cost matrix passes of work to json, per resolution down to the
+// coarsest one used: the cells the kernels filled, and the cells of the
+// passes' search windows, which abandoned passes only partly filled.
+void format_work(json_writer& json, const DTWStatistics& work) {
+    long cells = 0;
+    long window_cells = 0;
+    int levels = 0;
+    for (int level = 0; level < STATISTICS_MAX_LEVELS; ++level) {
+        cells += work.cells[level];
+        window_cells += work.windowCells[level];
+        if (work.passes[level] > 0) {
+            levels = level + 1;
+        }
+    }
+    json.field("cells", cells);
+    json.field("window_cells", window_cells);
+    json.field("peak_cost_matrix_bytes", long(work.peakCostMatrixBytes));
+    json.begin("levels", '[');
+    for (int level = 0; level < levels; ++level) {
+        json.begin(NULL, '{');
+        json.field("level", long(level));
+        json.field("passes", long(work.passes[level]));
+        json.field("cells", long(work.cells[level]));
+        json.field("window_cells", long(work.windowCells[level]));
+        json.field("mean_window_cells",
+                   work.passes[level] ? double(work.windowCells[level]) / work.passes[level] : 0.0);
+        json.field("max_window_cells", long(work.maxWindowCells[level]));
+        json.end('}');
+    }
+    json.end(']');
 }
 
-// compares query *list* against dataset.
-void one_NN_many(std::vector<taggedTS> queryset, std::vector<taggedTS> dataset, int use_time_domain, bool do_modelling)
+// Writes the --stats report to fname: what the comparisons of every query
+// took, and the totals of the run. comparison_seconds is the wall time of
+// the comparisons, total_seconds that of one_NN_many as a whole.
+void write_stats(const char* fname,
+                 const std::vector<taggedTS>& queryset,
+                 const std::vector<std::size_t>& candidate_counts,
+                 const std::vector<query_stats>& stats,
+                 const dtw_settings& settings,
+                 bool use_float,
+                 double comparison_seconds,
+                 double total_seconds,
+                 bool compact) {
+    query_stats run;
+    std::size_t candidates = 0;
+    for (std::size_t q = 0; q < stats.size(); ++q) {
+        run.counters.add(stats[q].counters);
+        run.seconds += stats[q].seconds;
+        run.dtw.merge(stats[q].dtw);
+        candidates += candidate_counts[q];
+    }
+    long cells = std::accumulate(run.dtw.cells, run.dtw.cells + STATISTICS_MAX_LEVELS, 0L);
+
+    json_writer json(compact);
+    json.begin(NULL, '{');
+    json.begin("run", '{');
+    json.field("algorithm", std::string(algorithm_name(settings.algorithm)));
+    json.field("radius", long(settings.radius));
+    json.field("precision", std::string(use_float ? "float" : "double"));
+    json.field("threads", long(omp_get_max_threads()));
+    json.field("queries", long(queryset.size()));
+    format_counters(json, candidates, run.counters);
+    json.field("total_seconds", total_seconds);
+    json.field("comparison_seconds", comparison_seconds);
+    json.field("thread_seconds", run.seconds);
+    json.field("pairs_per_second", comparison_seconds > 0 ? candidates / comparison_seconds : 0.0);
+    json.field("comparisons_per_second",
+               comparison_seconds > 0 ? run.counters.computed / comparison_seconds : 0.0);
+    json.field("cells_per_second", comparison_seconds > 0 ? cells / comparison_seconds : 0.0);
+    json.field("workspace_allocations", long(workspaceAllocations()));
+    format_work(json, run.dtw);
+    json.end('}');
+    json.begin("queries", '[');
+    for (std::size_t q = 0; q < stats.size(); ++q) {
+        json.begin(NULL, '{');
+        json.field("tag", queryset[q].ts_tag);
+        json.field("UID", queryset[q].UID);
+        format_counters(json, candidate_counts[q], stats[q].counters);
+        json.field("seconds", stats[q].seconds);
+        json.field("wall_seconds", stats[q].last_end > stats[q].first_start ?
+                   stats[q].last_end - stats[q].first_start : 0.0);
+        format_work(json, stats[q].dtw);
+        json.end('}');
+    }
+    json.end(']');
+    json.end('}');
+    json.out += '\n';
+
+    std::ofstream out(fname);
+    out.write(json.out.data(), json.out.size());
+    if (!out) {
+        cerr << "Could not write the statistics to \"" << fname << "\"." << endl;
+    }
+}
+
+// compares query *list* against dataset under settings, reporting the
+// nearest neighbours as options asks for. Unless cache is NULL, it is
+// consulted before every comparison and given every result (the series
+// need their content hashes, see hash_TS).
+void one_NN_many(const std::vector<taggedTS>& queryset,
+                 const std::vector<taggedTS>& dataset,
+                 int use_time_domain,
+                 const dtw_settings& settings,
+                 bool do_modelling,
+                 const nn_options& options,
+                 distance_cache* cache)
 {
+	double run_start = omp_get_wtime();
 	if(queryset.size() < 1)
 	{
 		cerr << "Invalid query set, shouldnt be empty.";
 		return;
 	}
-	// Output the outer array
-    wrp("[ ", [&]()
-    {
-        // Output one element from the query-set
-        auto outputter = [&](bool last)
-        {
-            return [&](taggedTS query)
-            {
-                wrp("{", [&]()
-                {
-                    // Output all neighbors of this query
-                    kNN_single(query,
-                               dataset,
-                               use_time_domain,
-							   do_modelling);
-
-                    // Output information on the query itself
-                    wrp(qs("ground_truth") + " : {", [&]()
-                    {
-                        kv(qs("tag"), qs(query.ts_tag));
-                        kv(qs("UID"), qs(query.UID), false);
-                        //kv(qs("id"), query.id, false);
-                    }, "}");
-                }, "}", !last);
-            };
-        };
-
-        // Output 0...n-1
-        for_each(queryset.begin(), queryset.end()-1, outputter(false));
-        // Output n
-        outputter(true)(queryset.back());
-    }, "]");
+	// The candidates of a query are compared in batches of up to
+	// STRI::BATCH_LANES with similar costs, i.e. similar lengths, since a
+	// batch runs as long as its longest member. One task per batch, most
+	// expensive first, so that the longest comparisons cannot end up as a
+	// straggler at the end. Candidates of equal cost are ordered by length,
+	// so that under cdtw, where every candidate shorter than the query costs
+	// the same, a batch holds candidates whose bands line up. A task is
+	// (cost, query, first member, number of members), the members being
+	// consecutive in batch_members.
+	typedef std::tuple<double, std::uint32_t, std::uint32_t, std::uint32_t> batch_task;
+	std::vector<batch_task> tasks;
+	std::vector<const taggedTS*> batch_members;
+	std::vector<std::size_t> candidate_counts(queryset.size(), 0);
+	std::vector<std::pair<double, std::uint32_t> > costs;
+	for (std::size_t q = 0; q < queryset.size(); ++q)
+	{
+		costs.clear();
+		for (std::size_t r = 0; r < dataset.size(); ++r)
+		{
+			if (!is_candidate(queryset[q], dataset[r], do_modelling))
+				continue;
+			costs.emplace_back(estimated_cost(queryset[q], dataset[r], use_time_domain, settings), r);
+			++candidate_counts[q];
+		}
+		std::sort(costs.begin(), costs.end(),
+		          [&dataset](const std::pair<double, std::uint32_t>& a,
+		                     const std::pair<double, std::uint32_t>& b)
+		{
+			if (a.first != b.first)
+				return a.first > b.first;
+			JInt length_a = dataset[a.second].series.size();
+			JInt length_b = dataset[b.second].series.size();
+			return length_a > length_b || (length_a == length_b && a.second < b.second);
+		});
+		for (std::size_t c = 0; c < costs.size(); )
+		{
+			std::size_t first = batch_members.size();
+			double leading = costs[c].first;
+			double total = 0;
+			do
+			{
+				batch_members.push_back(&dataset[costs[c].second]);
+				total += costs[c].first;
+				++c;
+			} while (c < costs.size() &&
+			         batch_members.size() - first < std::size_t(STRI::BATCH_LANES) &&
+			         costs[c].first >= BATCH_COST_RATIO * leading);
+			tasks.emplace_back(total, q, first, batch_members.size() - first);
+		}
+	}
+	std::sort(tasks.begin(), tasks.end(),
+	          [](const batch_task& a, const batch_task& b)
+	{
+		return std::get<0>(a) > std::get<0>(b) ||
+		  (std::get<0>(a) == std::get<0>(b) && a < b);
+	});
+
+	// k of 0 reports every remaining reference as a neighbour.
+	std::vector<std::size_t> query_k(queryset.size());
+	for (std::size_t q = 0; q < queryset.size(); ++q)
+	{
+		query_k[q] = options.k == 0 ? candidate_counts[q] : options.k;
+	}
+	std::unique_ptr<shared_threshold[]> thresholds(new shared_threshold[queryset.size()]);
+
+	// Per thread and query the nearest neighbours that thread found,
+	// created when the thread first compares against the query.
+	typedef std::vector<std::unique_ptr<neighbour_heap> > thread_heaps;
+	std::vector<thread_heaps> heaps(omp_get_max_threads());
+
+	// With --stats every task's work is added to its query's statistics.
+	bool collect_stats = options.stats_filename != NULL;
+	std::vector<query_stats> stats(collect_stats ? queryset.size() : 0);
+	std::unique_ptr<std::mutex[]> stats_locks(new std::mutex[stats.size()]);
+
+	work_stealing_queues queues(tasks.size(), omp_get_max_threads());
+	long cached = 0, kim = 0, keogh = 0, computed = 0, abandoned = 0;
+	double comparison_start = omp_get_wtime();
+	#pragma omp parallel reduction(+:cached,kim,keogh,computed,abandoned)
+	{
+		prune_counters local;
+		thread_heaps& own = heaps[omp_get_thread_num()];
+		own.resize(queryset.size());
+		std::size_t t;
+		while (queues.next(omp_get_thread_num(), t))
+		{
+			std::uint32_t q = std::get<1>(tasks[t]);
+			if (!own[q])
+			{
+				own[q].reset(new neighbour_heap(query_k[q]));
+			}
+			double start = 0;
+			if (collect_stats)
+			{
+				DTWStatistics::local().reset();
+				start = omp_get_wtime();
+			}
+			prune_counters task;
+			if (options.use_float)
+				kNN_worker<float>(queryset[q], &batch_members[std::get<2>(tasks[t])],
+				                  std::get<3>(tasks[t]), *own[q], thresholds[q],
+				                  use_time_domain, settings, cache, task);
+			else
+				kNN_worker<double>(queryset[q], &batch_members[std::get<2>(tasks[t])],
+				                   std::get<3>(tasks[t]), *own[q], thresholds[q],
+				                   use_time_domain, settings, cache, task);
+			local.add(task);
+			if (collect_stats)
+			{
+				double end = omp_get_wtime();
+				std::lock_guard<std::mutex> lock(stats_locks[q]);
+				stats[q].add(task, start, end, DTWStatistics::local());
+			}
+		}
+		cached += local.cached;
+		kim += local.kim;
+		keogh += local.keogh;
+		computed += local.computed;
+		abandoned += local.abandoned;
+	}
+	double comparison_seconds = omp_get_wtime() - comparison_start;
+	prune_counters counters;
+	counters.cached = cached;
+	counters.kim = kim;
+	counters.keogh = keogh;
+	counters.computed = computed;
+	counters.abandoned = abandoned;
+
+	// Every query is formatted into its own buffer, and the buffers are
+	// written out in query order with a single write at the end.
+	std::vector<std::string> results(queryset.size());
+	long validated = 0;
+	double max_deviation = 0, max_relative_deviation = 0;
+	#pragma omp parallel for schedule(dynamic) reduction(+:validated) reduction(max:max_deviation,max_relative_deviation)
+	for (std::size_t q = 0; q < queryset.size(); ++q)
+	{
+		// Merge what the threads found; vector of (distance, timeseries),
+		// nearest first
+		neighbour_heap merged(query_k[q]);
+		for (std::size_t thread = 0; thread < heaps.size(); ++thread)
+		{
+			if (q < heaps[thread].size() && heaps[thread][q])
+			{
+				for (const neighbour_heap::entry& e : heaps[thread][q]->entries)
+					merged.offer(std::get<0>(e), *std::get<1>(e));
+			}
+		}
+		std::vector<neighbour_heap::entry> neighbours = merged.take_sorted();
+		results[q] = format_result(queryset[q], neighbours, options.compact);
+		if (options.validate_precision)
+		{
+			for (const neighbour_heap::entry& e : neighbours)
+			{
+				double exact = DTWdist(queryset[q], *std::get<1>(e), use_time_domain, settings);
+				double deviation = std::fabs(std::get<0>(e) - exact);
+				max_deviation = std::max(max_deviation, deviation);
+				if (exact > 0)
+					max_relative_deviation = std::max(max_relative_deviation, deviation / exact);
+				++validated;
+			}
+		}
+	}
+
+	json_writer json(options.compact);
+	json.begin(NULL, '[');
+	for (std::size_t q = 0; q < results.size(); ++q)
+	{
+		json.raw(results[q]);
+		std::string().swap(results[q]);
+	}
+	json.end(']');
+	json.out += '\n';
+	cout.write(json.out.data(), json.out.size());
+	cout.flush();
+
+    if (options.verbose) {
+        if (cache) {
+            cerr << "answered from cache: " << counters.cached << ", ";
+        }
+        cerr << "pruned by LB_Kim: " << counters.kim <<
+            ", pruned by LB_Keogh: " << counters.keogh <<
+            ", compared: " << counters.computed <<
+            " (abandoned early: " << counters.abandoned << ")" <<
+            ", workspace allocations: " << workspaceAllocations() << "\n";
+    }
+    if (options.validate_precision) {
+        cerr << "deviation from double precision over " << validated <<
+            " reported distances: at most " << max_deviation <<
+            " (relative " << max_relative_deviation << ")\n";
+    }
+    if (collect_stats) {
+        write_stats(options.stats_filename, queryset, candidate_counts, stats, settings,
+                    options.use_float, comparison_seconds, omp_get_wtime() - run_start,
+                    options.compact);
+    }
 }
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef TAGGED_TS_H
+#define TAGGED_TS_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <mutex>
+
+#include "TimeSeries.h"
+#include "PAAPyramid.h"
+#include "mapped_file.h"
+
+using namespace fastdtw;
+
+// PAA pyramid of a series, built by the first comparison that needs it.
+template <typename ValueType>
+struct lazy_pyramid {
+    std::once_flag built;
+    std::unique_ptr<const PAAPyramid<ValueType,1> > pyramid;
+
+    const PAAPyramid<ValueType,1>& get(const TimeSeries<ValueType,1>& series) {
+        std::call_once(built, [&]() {
+            pyramid.reset(new PAAPyramid<ValueType,1>(series));
+        });
+        return *pyramid;
+    }
+};
+
+// One series of a .job file (or of its binary form, see ts_binary.h).
+struct taggedTS {
+    // Empty if the series was loaded from a binary file without its times,
+    // see load_TSbinary.
+    std::vector<int> ts_abs_data;
+    std::string ts_tag;
+    int id;
+    std::string UID;
+
+    // The return times, stored contiguously in the representation FastDTW
+    // consumes; comparisons take prefix views of it rather than copies.
+    TimeSeries<double,1> series;
+    // Whether ts_abs_data is non-decreasing, so prefixes can be found by
+    // binary search.
+    bool abs_sorted;
+    // Keeps the memory mapped file alive that series views, if it was
+    // loaded from one.
+    std::shared_ptr<const mapped_file> storage;
+    // The coarser resolutions of series that FastDTW recurses through,
+    // shared by every comparison that uses the whole series.
+    std::unique_ptr<lazy_pyramid<double> > pyramid;
+    // series rounded to float and its pyramid, for comparisons in single
+    // precision; empty unless narrow_TS was called or the series was loaded
+    // from a float32 binary file.
+    TimeSeries<float,1> series_float;
+    std::unique_ptr<lazy_pyramid<float> > pyramid_float;
+    // Hash of the series and the absolute times, identifying the series
+    // across runs; 0 unless hash_TS was called.
+    std::uint64_t content_hash = 0;
+
+    // The series and pyramid comparisons in ValueType precision use.
+    template <typename ValueType>
+    const TimeSeries<ValueType,1>& get_series() const;
+
+    template <typename ValueType>
+    const PAAPyramid<ValueType,1>& get_pyramid() const;
+};
+
+template <>
+inline const TimeSeries<double,1>& taggedTS::get_series<double>() const {
+    return series;
+}
+
+template <>
+inline const TimeSeries<float,1>& taggedTS::get_series<float>() const {
+    return series_float;
+}
+
+template <>
+inline const PAAPyramid<double,1>& taggedTS::get_pyramid<double>() const {
+    return pyramid->get(series);
+}
+
+template <>
+inline const PAAPyramid<float,1>& taggedTS::get_pyramid<float>() const {
+    return pyramid_float->get(series_float);
+}
+
+// Builds the derived members of a taggedTS once its series and absolute
+// times are in place.
+void prepare_TS(taggedTS& ts) {
+    ts.abs_sorted = std::is_sorted(ts.ts_abs_data.begin(), ts.ts_abs_data.end());
+    ts.pyramid.reset(new lazy_pyramid<double>());
+}
+
+// Takes over the parsed return times and builds the derived members of a
+// freshly parsed taggedTS.
+void prepare_TS(taggedTS& ts, std::vector<double>&& ret_data) {
+    ts.series = TimeSeries<double,1>(std::move(ret_data));
+    prepare_TS(ts);
+}
+
+// Fills in the float copy of the series of ts, for --precision=float. Series
+// loaded from float32 binary files already view their stored floats.
+void narrow_TS(taggedTS& ts) {
+    if (ts.pyramid_float) {
+        return;
+    }
+    std::vector<float> narrowed(ts.series.data(), ts.series.data() + ts.series.size());
+    ts.series_float = TimeSeries<float,1>(std::move(narrowed));
+    ts.pyramid_float.reset(new lazy_pyramid<float>());
+}
+
+// Finaliser of splitmix64; every bit of the result depends on every bit of
+// value.
+inline std::uint64_t mix_hash(std::uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+inline std::uint64_t combine_hash(std::uint64_t hash, std::uint64_t value) {
+    return mix_hash((hash ^ value) + 0x9e3779b97f4a7c15ULL);
+}
+
+// Fills in content_hash of ts, for --cache. Hashes the values as stored in
+// double precision, so it does not depend on narrow_TS.
+void hash_TS(taggedTS& ts) {
+    std::uint64_t hash = combine_hash(0, ts.series.size());
+    const double* values = ts.series.data();
+    for (JInt i = 0; i < ts.series.size(); ++i) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &values[i], sizeof(bits));
+        hash = combine_hash(hash, bits);
+    }
+    hash = combine_hash(hash, ts.ts_abs_data.size());
+    for (std::size_t i = 0; i < ts.ts_abs_data.size(); ++i) {
+        hash = combine_hash(hash, static_cast<std::uint32_t>(ts.ts_abs_data[i]));
+    }
+    ts.content_hash = hash;
+}
+
+// TODO: perhaps find a better way to keep track of this.
+int global_id = 0;
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef TS_BINARY_H
+#define TS_BINARY_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include "tagged_ts.h"
+#include "mapped_file.h"
+
+// Binary form of a .job file, meant to be memory mapped. Layout, all
+// integers in native byte order (byte_order tells a reader whether that
+// matches its own):
+//
+//   ts_binary_header
+//   ts_binary_entry[count]     one per series, in file order
+//   string table               NUL terminated tags and UIDs, deduplicated
+//   values                     one contiguous array per series, each
+//                              starting on a 64 byte boundary
+//   absolute times             per series the zigzag encoded differences to
+//                              the previous time (the first to 0), as
+//                              LEB128 varints
+//
+// Offsets in the header are from the start of the file, offsets in the
+// entries from the start of their section.
+
+const char TS_BINARY_MAGIC[8] = {'K','N','N','D','T','W','B','\0'};
+const std::uint32_t TS_BINARY_VERSION = 1;
+const std::uint32_t TS_BINARY_BYTE_ORDER = 0x01020304;
+const std::uint64_t TS_BINARY_ALIGNMENT = 64;
+
+enum ts_binary_value_type {
+    TS_BINARY_FLOAT64 = 1,
+    TS_BINARY_FLOAT32 = 2
+};
+
+struct ts_binary_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t value_type;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::uint64_t entries_offset;
+    std::uint64_t strings_offset;
+    std::uint64_t values_offset;
+    std::uint64_t times_offset;
+};
+
+struct ts_binary_entry {
+    std::uint64_t values_offset;
+    std::uint64_t length;
+    std::uint64_t times_offset;
+    std::uint64_t times_count;
+    std::uint64_t tag_offset;
+    std::uint64_t uid_offset;
+};
+
+// Whether fname starts with the binary format's magic.
+bool is_TSbinary(const std::string& fname) {
+    std::ifstream file(fname.c_str(), std::ifstream::in | std::ifstream::binary);
+    char magic[sizeof(TS_BINARY_MAGIC)];
+    return file.read(magic, sizeof(magic)) &&
+        std::memcmp(magic, TS_BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+inline void put_varint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Returns false if the varint runs past end.
+inline bool get_varint(const unsigned char*& p, const unsigned char* end,
+                       std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline std::uint64_t align_up(std::uint64_t offset) {
+    return (offset + TS_BINARY_ALIGNMENT - 1) / TS_BINARY_ALIGNMENT * TS_BINARY_ALIGNMENT;
+}
+
+// Writes dataset to fname, storing the values as float32 if as_float is
+// set. Returns false if the file could not be written.
+bool write_TSbinary(const std::vector<taggedTS>& dataset,
+                    const std::string& fname, bool as_float) {
+    const std::uint64_t value_size = as_float ? sizeof(float) : sizeof(double);
+    std::vector<ts_binary_entry> entries(dataset.size());
+    std::string strings;
+    std::string times;
+    std::map<std::string, std::uint64_t> string_offsets;
+
+    std::uint64_t values_size = 0;
+    for (std::size_t i = 0; i < dataset.size(); ++i) {
+        const taggedTS& ts = dataset[i];
+        ts_binary_entry& entry = entries[i];
+        const std::string* names[2] = {&ts.ts_tag, &ts.UID};
+        std::uint64_t* offsets[2] = {&entry.tag_offset, &entry.uid_offset};
+        for (int s = 0; s < 2; ++s) {
+            std::map<std::string, std::uint64_t>::iterator it = string_offsets.find(*names[s]);
+            if (it == string_offsets.end()) {
+                it = string_offsets.insert(std::make_pair(*names[s], strings.size())).first;
+                strings.append(*names[s]);
+                strings.push_back('\0');
+            }
+            *offsets[s] = it->second;
+        }
+
+        entry.values_offset = values_size;
+        entry.length = ts.series.size();
+        values_size = align_up(values_size + entry.length * value_size);
+
+        entry.times_offset = times.size();
+        entry.times_count = ts.ts_abs_data.size();
+        std::int64_t previous = 0;
+        for (std::size_t j = 0; j < ts.ts_abs_data.size(); ++j) {
+            std::int64_t delta = static_cast<std::int64_t>(ts.ts_abs_data[j]) - previous;
+            previous = ts.ts_abs_data[j];
+            put_varint(times, (static_cast<std::uint64_t>(delta) << 1) ^
+                              static_cast<std::uint64_t>(delta >> 63));
+        }
+    }
+
+    ts_binary_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TS_BINARY_MAGIC, sizeof(header.magic));
+    header.version = TS_BINARY_VERSION;
+    header.byte_order = TS_BINARY_BYTE_ORDER;
+    header.value_type = as_float ? TS_BINARY_FLOAT32 : TS_BINARY_FLOAT64;
+    header.count = dataset.size();
+    header.entries_offset = sizeof(header);
+    header.strings_offset = header.entries_offset + entries.size() * sizeof(ts_binary_entry);
+    header.values_offset = align_up(header.strings_offset + strings.size());
+    header.times_offset = header.values_offset + values_size;
+
+    std::ofstream out(fname.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (!out) {
+        return false;
+    }
+    const std::vector<char> padding(TS_BINARY_ALIGNMENT, 0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!entries.empty()) {
+        out.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(ts_binary_entry));
+    }
+    out.write(strings.data(), strings.size());
+    out.write(&padding[0], header.values_offset - (header.strings_offset + strings.size()));
+    for (std::size_t i = 0; i < dataset.size(); ++i) {
+        const double* values = dataset[i].series.data();
+        std::uint64_t written = entries[i].length * value_size;
+        if (as_float) {
+            std::vector<float> narrowed(values, values + entries[i].length);
+            out.write(reinterpret_cast<const char*>(narrowed.data()), written);
+        } else {
+            out.write(reinterpret_cast<const char*>(values), written);
+        }
+        out.write(&padding[0], align_up(written) - written);
+    }
+    out.write(times.data(), times.size());
+    return static_cast<bool>(out);
+}
+
+inline void ts_binary_corrupt(const std::string& fname, const char* what) {
+    cerr << "Corrupt binary dataset \"" << fname << "\": " << what << endl;
+    abort();
+}
+
+// Loads a file written by write_TSbinary. The file is memory mapped and
+// float64 series are views straight into the mapping, so only the pages
+// that are actually compared get read. float32 series are views as well
+// for --precision=float (series_float, see narrow_TS), but their double
+// series, which the lower bounds and double comparisons read, is widened
+// into owned storage. The absolute times are only decoded if load_times is
+// set; otherwise ts_abs_data stays empty, which is fine as long as the
+// series are not compared in the time domain or hashed (see hash_TS).
+std::vector<taggedTS> load_TSbinary(std::string fname, int verbose, bool load_times) {
+    std::shared_ptr<const mapped_file> file = mapped_file::open(fname);
+    if (!file) {
+        cout << "No such file \"" << fname << "\" in folder." << endl;
+        abort();
+    }
+
+    ts_binary_header header;
+    if (file->size < sizeof(header)) {
+        ts_binary_corrupt(fname, "truncated header");
+    }
+    std::memcpy(&header, file->data, sizeof(header));
+    if (std::memcmp(header.magic, TS_BINARY_MAGIC, sizeof(header.magic)) != 0) {
+        ts_binary_corrupt(fname, "bad magic");
+    }
+    if (header.byte_order != TS_BINARY_BYTE_ORDER) {
+        ts_binary_corrupt(fname, "written with a different byte order");
+    }
+    if (header.version != TS_BINARY_VERSION) {
+        ts_binary_corrupt(fname, "unsupported version");
+    }
+    if (header.value_type != TS_BINARY_FLOAT64 && header.value_type != TS_BINARY_FLOAT32) {
+        ts_binary_corrupt(fname, "unknown value type");
+    }
+    const std::uint64_t value_size =
+        header.value_type == TS_BINARY_FLOAT32 ? sizeof(float) : sizeof(double);
+    if (header.entries_offset > file->size ||
+        header.count > (file->size - header.entries_offset) / sizeof(ts_binary_entry) ||
+        header.entries_offset + header.count * sizeof(ts_binary_entry) > header.strings_offset ||
+        header.strings_offset > header.values_offset ||
+        header.values_offset > header.times_offset ||
+        header.times_offset > file->size ||
+        header.values_offset % TS_BINARY_ALIGNMENT != 0) {
+        ts_binary_corrupt(fname, "bad section offsets");
+    }
+
+    const ts_binary_entry* entries =
+        reinterpret_cast<const ts_binary_entry*>(file->data + header.entries_offset);
+    const char* strings = file->data + header.strings_offset;
+    const std::uint64_t strings_size = header.values_offset - header.strings_offset;
+    const char* values = file->data + header.values_offset;
+    const std::uint64_t values_size = header.times_offset - header.values_offset;
+    const unsigned char* times_end = reinterpret_cast<const unsigned char*>(file->data + file->size);
+
+    std::vector<taggedTS> tsbuffer(header.count);
+    for (std::uint64_t i = 0; i < header.count; ++i) {
+        const ts_binary_entry& entry = entries[i];
+        taggedTS& current_ts = tsbuffer[i];
+
+        if (entry.tag_offset >= strings_size || entry.uid_offset >= strings_size ||
+            std::memchr(strings + entry.tag_offset, '\0', strings_size - entry.tag_offset) == NULL ||
+            std::memchr(strings + entry.uid_offset, '\0', strings_size - entry.uid_offset) == NULL) {
+            ts_binary_corrupt(fname, "bad string offset");
+        }
+        current_ts.ts_tag = strings + entry.tag_offset;
+        current_ts.UID = strings + entry.uid_offset;
+
+        if (entry.values_offset % TS_BINARY_ALIGNMENT != 0 ||
+            entry.values_offset > values_size ||
+            entry.length > (values_size - entry.values_offset) / value_size) {
+            ts_binary_corrupt(fname, "bad value offset");
+        }
+        if (header.value_type == TS_BINARY_FLOAT64) {
+            current_ts.series = TimeSeries<double,1>(
+                reinterpret_cast<const double*>(values + entry.values_offset), entry.length);
+        } else {
+            const float* narrowed = reinterpret_cast<const float*>(values + entry.values_offset);
+            current_ts.series = TimeSeries<double,1>(
+                std::vector<double>(narrowed, narrowed + entry.length));
+            current_ts.series_float = TimeSeries<float,1>(narrowed, entry.length);
+            current_ts.pyramid_float.reset(new lazy_pyramid<float>());
+        }
+        current_ts.storage = file;
+
+        // Every time takes at least one byte.
+        const std::uint64_t times_size = file->size - header.times_offset;
+        if (entry.times_offset > times_size ||
+            entry.times_count > times_size - entry.times_offset) {
+            ts_binary_corrupt(fname, "bad times offset");
+        }
+        if (load_times) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(
+                file->data + header.times_offset) + entry.times_offset;
+            current_ts.ts_abs_data.reserve(entry.times_count);
+            std::int64_t previous = 0;
+            for (std::uint64_t j = 0; j < entry.times_count; ++j) {
+                std::uint64_t zigzag;
+                if (!get_varint(p, times_end, zigzag)) {
+                    ts_binary_corrupt(fname, "truncated absolute times");
+                }
+                previous += static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+                current_ts.ts_abs_data.push_back(static_cast<int>(previous));
+            }
+        }
+
+        current_ts.id = global_id++;
+        prepare_TS(current_ts);
+    }
+
+    if (verbose) {
+        cout << "processed: " <<
+            tsbuffer.size() <<
+            " vectors in file " <<
+            fname.c_str() << "\n";
+    }
+
+    return tsbuffer;
+}
+
+#endif
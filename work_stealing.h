@@ -0,0 +1,72 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Hands out the task indices 0..count-1 to a team of threads. Task i is
+// dealt to thread i % threads, so when the tasks are sorted by decreasing
+// cost every thread starts on its share of the expensive ones (longest
+// processing time first). A thread takes tasks from the front of its own
+// share and, once that is empty, steals from the back of the others', where
+// the cheapest tasks are. Each share is limited to 2^32 tasks.
+class work_stealing_queues {
+public:
+    work_stealing_queues(std::size_t count, int threads)
+        : count_(count), threads_(threads > 0 ? threads : 1),
+          shares_(new share[threads_]) {
+        for (int t = 0; t < threads_; ++t) {
+            std::uint64_t size = count_ > std::size_t(t) ? (count_ - t + threads_ - 1) / threads_ : 0;
+            shares_[t].bounds.store(size << 32);
+        }
+    }
+
+    // Takes the next task for thread; returns false once every task has
+    // been handed out. thread may be any number, the threads beyond the
+    // ones that were dealt a share only steal.
+    bool next(int thread, std::size_t& task) {
+        int own = thread % threads_;
+        if (take(own, true, task)) {
+            return true;
+        }
+        for (int i = 1; i < threads_; ++i) {
+            if (take((own + i) % threads_, false, task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Remaining positions [head, tail) of a thread's share, packed into one
+    // word (head in the low half) so that both ends move with a single CAS.
+    struct alignas(64) share {
+        std::atomic<std::uint64_t> bounds;
+    };
+
+    bool take(int owner, bool front, std::size_t& task) {
+        std::atomic<std::uint64_t>& bounds = shares_[owner].bounds;
+        std::uint64_t current = bounds.load(std::memory_order_relaxed);
+        while (true) {
+            std::uint64_t head = current & 0xffffffff;
+            std::uint64_t tail = current >> 32;
+            if (head >= tail) {
+                return false;
+            }
+            std::uint64_t position = front ? head : tail - 1;
+            std::uint64_t updated = front ? (tail << 32) | (head + 1) : ((tail - 1) << 32) | head;
+            if (bounds.compare_exchange_weak(current, updated, std::memory_order_relaxed)) {
+                task = position * threads_ + owner;
+                return true;
+            }
+        }
+    }
+
+    std::size_t count_;
+    int threads_;
+    std::unique_ptr<share[]> shares_;
+};
+
+#endif